@@ -0,0 +1,273 @@
+// Benchmarks of effects, particles, compositing and whole frames.
+// Prints one JSON object per line so results can be compared between releases:
+//   ./chroma_bench [FILTER] > results.jsonl
+// Only benchmarks whose name contains FILTER are run.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "chroma.hpp"
+#include "compositor.hpp"
+#include "effects.hpp"
+#include "kernels.hpp"
+#include "particles.hpp"
+#include "program.hpp"
+#include "render_pool.hpp"
+
+#define BENCH_SAMPLES 5
+#define BENCH_SAMPLE_SECONDS 0.02
+#define BENCH_EFFECT_PIXELS 1024
+
+typedef std::function<std::shared_ptr<ChromaEffect>()> EffectFactory;
+
+static std::string filter;
+
+double get_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Times fn, which does work on the given number of pixels per call, and prints the median of several samples.
+// Each sample calls fn enough times to take about BENCH_SAMPLE_SECONDS.
+void run_benchmark(const std::string& name, size_t pixels, nlohmann::json params, const std::function<void()>& fn) {
+    if (name.find(filter) == std::string::npos)
+        return;
+
+    fn(); // Warm up caches and thread local buffers
+    size_t iterations = 1;
+    for (double start = get_seconds(); get_seconds() - start < BENCH_SAMPLE_SECONDS / 4; iterations *= 2) {
+        for (size_t i = 0; i < iterations; i++)
+            fn();
+    }
+
+    std::vector<double> samples;
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        double start = get_seconds();
+        for (size_t i = 0; i < iterations; i++)
+            fn();
+        samples.push_back((get_seconds() - start) * 1e9 / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    double ns = samples[BENCH_SAMPLES / 2];
+
+    params["name"] = name;
+    params["pixels"] = pixels;
+    params["iterations"] = iterations * BENCH_SAMPLES;
+    params["ns_per_op"] = ns;
+    params["ns_per_pixel"] = pixels > 0 ? ns / pixels : 0;
+    params["ns_min"] = samples.front();
+    params["ns_max"] = samples.back();
+    params["isa"] = get_kernels().isa;
+    params["hardware_threads"] = std::thread::hardware_concurrency();
+    printf("%s\n", params.dump().c_str());
+    fflush(stdout);
+}
+
+std::shared_ptr<ChromaEffect> make_color(int r, int g, int b) {
+    return std::make_shared<ColorEffect>(std::vector<ChromaData>({ChromaData(r), ChromaData(g), ChromaData(b)}));
+}
+
+std::shared_ptr<ChromaEffect> make_rainbow() {
+    return std::make_shared<RainbowEffect>(std::vector<ChromaData>());
+}
+
+ChromaData as_data(const std::shared_ptr<ChromaObject>& object) {
+    return ChromaData(object);
+}
+
+template <class T>
+std::shared_ptr<ChromaEffect> make_effect(const std::vector<ChromaData>& args) {
+    return std::make_shared<T>(args);
+}
+
+// Red, green and blue as the list argument of split and gradient
+ChromaData primaries() {
+    return ChromaData(std::vector<ChromaData>({as_data(make_color(255, 0, 0)), as_data(make_color(0, 255, 0)), as_data(make_color(0, 0, 255))}));
+}
+
+// The tree of scripts/test.chroma: (wave (split (gradient RED GREEN) (slide rainbow 10)) 10 150)
+std::shared_ptr<ChromaEffect> make_nested_scene() {
+    ChromaData colors(std::vector<ChromaData>({as_data(make_color(255, 0, 0)), as_data(make_color(0, 255, 0))}));
+    ChromaData sections(std::vector<ChromaData>({
+        as_data(make_effect<GradientEffect>({colors})),
+        as_data(make_effect<SlideEffect>({as_data(make_rainbow()), 10.0f}))
+    }));
+    return make_effect<WaveEffect>({as_data(make_effect<SplitEffect>({sections})), 10.0f, 150.0f});
+}
+
+std::vector<std::pair<std::string, EffectFactory>> get_effects() {
+    auto child = [](){ return as_data(make_rainbow()); };
+    return {
+        {"rgb", [](){ return make_color(255, 128, 0); }},
+        {"alpha", [=](){ return make_effect<AlphaEffect>({child(), 0.5f}); }},
+        {"rainbow", [](){ return make_rainbow(); }},
+        {"split", [](){ return make_effect<SplitEffect>({primaries()}); }},
+        {"gradient", [](){ return make_effect<GradientEffect>({primaries()}); }},
+        {"slide", [=](){ return make_effect<SlideEffect>({child(), 2.0f}); }},
+        {"wipe", [=](){ return make_effect<WipeEffect>({child(), 2.0f}); }},
+        {"worm", [=](){ return make_effect<WormEffect>({child(), 2.0f}); }},
+        {"blink", [=](){ return make_effect<BlinkEffect>({child(), 0.5f}); }},
+        {"blinkfade", [=](){ return make_effect<BlinkFadeEffect>({child(), 0.5f}); }},
+        {"fadein", [=](){ return make_effect<FadeInEffect>({child(), 1e6f}); }},
+        {"fadeout", [=](){ return make_effect<FadeOutEffect>({child(), 1e6f}); }},
+        {"wave", [=](){ return make_effect<WaveEffect>({child(), 2.0f, 30.0f}); }},
+        {"wheel", [=](){ return make_effect<WheelEffect>({child(), 2.0f}); }},
+        {"nested", [](){ return make_nested_scene(); }},
+    };
+}
+
+void bench_effects() {
+    std::vector<float> indices(BENCH_EFFECT_PIXELS);
+    std::vector<vec4> out(BENCH_EFFECT_PIXELS);
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = static_cast<float>(i) / indices.size();
+
+    for (auto& entry : get_effects()) {
+        std::shared_ptr<ChromaEffect> effect = entry.second();
+        ChromaState state;
+        state.pixel_length = BENCH_EFFECT_PIXELS;
+        state.time = 0;
+        state.delta_time = 1.0f / 60;
+
+        // Tick and draw every pixel, like one frame of a layer without caching
+        run_benchmark("effect/" + entry.first, BENCH_EFFECT_PIXELS, {{"mode", "span"}}, [&](){
+            state.time += state.delta_time;
+            effect->tick(state);
+            for (size_t i = 0; i < indices.size(); i += CHROMA_SPAN_MAX)
+                effect->draw_span(indices.data() + i, out.data() + i, std::min(indices.size() - i, (size_t) CHROMA_SPAN_MAX), state);
+        });
+
+        ChromaProgram program;
+        run_benchmark("effect/" + entry.first, BENCH_EFFECT_PIXELS, {{"mode", "compiled"}}, [&](){
+            state.time += state.delta_time;
+            effect->tick(state);
+            program.compile(*effect, state);
+            program.run(indices.data(), out.data(), indices.size(), state);
+        });
+    }
+}
+
+std::shared_ptr<ParticleSystem> make_particle_system(size_t count, float pixel_length) {
+    std::vector<ChromaData> particles;
+    for (size_t i = 0; i < count; i++) {
+        float position = (i + 0.5f) * pixel_length / count;
+        float velocity = (i % 2 == 0 ? 1 : -1) * (10.0f + i % 7);
+        auto body = std::make_shared<PhysicsBody>(std::vector<ChromaData>({ChromaData(position), ChromaData(velocity)}));
+        particles.push_back(as_data(std::make_shared<ParticleEffect>(std::vector<ChromaData>({
+            as_data(make_color(255, 64 * (i % 4), 0)), as_data(body), 1.0f
+        }))));
+    }
+    return std::make_shared<ParticleSystem>(std::vector<ChromaData>({ChromaData(particles)}));
+}
+
+void bench_particles() {
+    const size_t pixel_length = 10000;
+    std::vector<float> indices(pixel_length);
+    std::vector<vec4> out(pixel_length);
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = static_cast<float>(i) / indices.size();
+
+    for (size_t count : {10, 100, 1000}) {
+        auto system = make_particle_system(count, pixel_length);
+        ChromaState state;
+        state.pixel_length = pixel_length;
+        state.time = 0;
+        state.delta_time = 1.0f / 60;
+
+        run_benchmark("particles/tick", 0, {{"particles", count}}, [&](){
+            state.time += state.delta_time;
+            system->tick(state);
+        });
+        run_benchmark("particles/draw", pixel_length, {{"particles", count}}, [&](){
+            system->draw_span(indices.data(), out.data(), indices.size(), state);
+        });
+    }
+}
+
+void bench_compositing() {
+    const size_t pixel_length = 4096;
+    std::vector<float> indices(pixel_length);
+    std::vector<vec4> out(pixel_length);
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = static_cast<float>(i) / indices.size();
+
+    ChromaState state;
+    state.pixel_length = pixel_length;
+    state.time = 1;
+    state.delta_time = 1.0f / 60;
+
+    for (BlendMode mode : {BLEND_OVER, BLEND_ADD, BLEND_SCREEN}) {
+        for (size_t count : {1, 4, 16}) {
+            // Translucent layers so alpha-over cannot stop at the top layer
+            std::vector<ChromaLayer> layers(count);
+            for (auto& layer : layers) {
+                layer.effect = make_effect<AlphaEffect>({as_data(make_rainbow()), 0.5f});
+                layer.blend_mode = mode;
+            }
+            run_benchmark("composite/" + blend_mode_to_string(mode), pixel_length, {{"layers", count}}, [&](){
+                composite_layers(layers, indices.data(), out.data(), 0, pixel_length, state);
+            });
+        }
+    }
+}
+
+void bench_frames() {
+    for (size_t pixel_length : {150, 10000, 1000000}) {
+        ChromaOutput output("bench", pixel_length, 60);
+        output.set_effect(make_effect<SlideEffect>({as_data(make_rainbow()), 2.0f}));
+        output.add_layer();
+        output.set_current_layer(1);
+        output.set_blend_mode(BLEND_ADD);
+        output.set_effect(make_effect<WaveEffect>({as_data(make_color(0, 0, 255)), 1.0f, 30.0f}));
+
+        for (size_t threads : {1, 2, 4, 8, 16}) {
+            RenderPool pool(threads);
+            ChromaState state;
+            state.pixel_length = pixel_length;
+            state.time = 0;
+            state.delta_time = 1.0f / 60;
+            ChromaFrame frame;
+            run_benchmark("frame", pixel_length, {{"threads", threads}}, [&](){
+                state.time += state.delta_time;
+                output.render(pool, state, frame);
+            });
+        }
+    }
+}
+
+// Whole frames of the nested scene, drawn both through compiled programs and by walking the tree
+void bench_nested_frames() {
+    for (size_t pixel_length : {150, 10000}) {
+        ChromaOutput output("bench", pixel_length, 60);
+        output.set_effect(make_nested_scene());
+        RenderPool pool(1);
+        for (bool compiled : {false, true}) {
+            ChromaState state;
+            state.pixel_length = pixel_length;
+            state.time = 0;
+            state.delta_time = 1.0f / 60;
+            ChromaFrame frame;
+            run_benchmark("frame/nested", pixel_length, {{"threads", 1}, {"compiled", compiled}}, [&](){
+                state.time += state.delta_time;
+                output.render(pool, state, frame, compiled);
+            });
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1)
+        filter = argv[1];
+    bench_effects();
+    bench_particles();
+    bench_compositing();
+    bench_frames();
+    bench_nested_frames();
+    return 0;
+}
@@ -1,79 +1,744 @@
-#include <boost/asio.hpp>
-
 #include "chroma.hpp"
+#include "compositor.hpp"
+#include "memo.hpp"
+#include "program.hpp"
+#include "spsc_queue.hpp"
+
+#define PIPELINE_BUFFERS 3
+
+// Frame buffers handed between an output's render thread and its send thread
+struct FramePipeline {
+    ChromaFrame buffers[PIPELINE_BUFFERS];
+    SPSCQueue<size_t, PIPELINE_BUFFERS> ready;
+    SPSCQueue<size_t, PIPELINE_BUFFERS> free;
+    std::atomic<bool> sending = false;
+    std::atomic<bool> failed = false;
+    std::thread sender;
+    // Only taken to sleep on an empty queue, pushes stay lock-free and just wake the other thread
+    std::mutex lock;
+    std::condition_variable changed;
 
-double get_now() {
-    return std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch()
-    ).count();
+    void push(SPSCQueue<size_t, PIPELINE_BUFFERS>& queue, size_t index) {
+        queue.push(index);
+        this->wake();
+    }
+    // Taking the lock orders the wake after a waiter's last look at the queue, so it cannot be missed
+    void wake() {
+        { std::lock_guard<std::mutex> guard(this->lock); }
+        this->changed.notify_all();
+    }
+    // Pops the next buffer, false once the queue is empty and until is false
+    template <class Until>
+    bool wait_pop(SPSCQueue<size_t, PIPELINE_BUFFERS>& queue, size_t& index, Until until) {
+        if (queue.pop(index))
+            return true;
+        std::unique_lock<std::mutex> guard(this->lock);
+        bool popped = false;
+        this->changed.wait(guard, [&](){ return (popped = queue.pop(index)) || !until(); });
+        return popped;
+    }
+};
+
+static ChromaLayer new_layer() {
+    ChromaLayer layer;
+    layer.program = std::make_shared<ChromaProgram>();
+    return layer;
 }
 
-void ChromaController::run(int fps, size_t pixel_length, std::function<int(const std::vector<vec4>&)> callback) {
-    this->running = true;
-    double us_per_frame = 1e6 / fps;
+// Called before publishing a stack whose effects changed
+static void find_shared_effects(LayerStack& layers) {
+    std::shared_ptr<const SharedEffects> shared = SharedEffects::find(layers);
+    for (ChromaLayer& layer : layers)
+        layer.shared = shared;
+}
 
-    ChromaState state;
-    state.pixel_length = pixel_length;
-    state.time = 0;
+// Ticks a layer's effect unless it is shared with a layer ticked before it this frame
+static void tick_layer(EffectProfiler& profiler, bool profiling, size_t l, ChromaEffect& effect, const ChromaState& state) {
+    if (state.shared != nullptr && !state.shared->claim_tick(&effect, state.frame))
+        return;
+    if (profiling)
+        profile_tick(profiler, l, effect, state);
+    else
+        effect.tick(state);
+}
+
+static std::atomic<uint64_t> next_frame = 1;
 
-    std::vector<vec4> pixels(pixel_length);
+static size_t get_ring_bytes(const LayerBake& bake, size_t pixel_length) {
+    return bake.frames * pixel_length * (bake.half ? 4 * sizeof(uint16_t) : sizeof(vec4));
+}
 
-    double start_time = get_now();
-    
-    boost::asio::thread_pool pool(4);
+// Draws frame slot of a layer's baked loop across the render threads, at the state the layer was ticked at
+static void draw_bake_frame(RenderPool& pool, const ChromaLayer& layer, LayerBake& bake, size_t slot, const ChromaState& state) {
+    size_t pixel_length = state.pixel_length;
+    pool.parallel_for(pixel_length, CHROMA_SPAN_MAX, [&](size_t start, size_t end){
+        float indices[CHROMA_SPAN_MAX];
+        for (size_t i = start; i < end; i++)
+            indices[i - start] = static_cast<float>(i) / pixel_length;
+        size_t pixel = slot * pixel_length + start;
+        if (!bake.half) {
+            draw_pixels(layer, indices, bake.pixels.data() + pixel, start, end - start, state);
+            return;
+        }
+        vec4 pixels[CHROMA_SPAN_MAX];
+        draw_pixels(layer, indices, pixels, start, end - start, state);
+        get_kernels().to_half(bake.half_pixels.data() + pixel * 4, &pixels[0].x, (end - start) * 4);
+    });
+}
+
+ChromaOutput::ChromaOutput(const std::string& component_id, size_t pixel_length, int fps) :
+    component_id(component_id), pixel_length(pixel_length), fps(fps), layers(new LayerStack(1, new_layer())),
+    layout(make_linear_layout(pixel_length)) { }
+
+void ChromaOutput::set_effect(const std::shared_ptr<ChromaEffect>& effect) {
+    {
+        std::lock_guard<std::mutex> guard(this->layers_lock);
+        LayerStack* layers = new LayerStack(*this->layers.get());
+        ChromaLayer& layer = (*layers)[this->current_layer];
+        layer.effect = effect;
+        layer.cache = std::make_shared<LayerCache>();
+        layer.keyframes = std::make_shared<LayerKeyframes>();
+        layer.samples = std::make_shared<LayerSamples>();
+        layer.bake = std::make_shared<LayerBake>();
+        find_shared_effects(*layers);
+        this->layers.publish(layers); // The old effect is freed here once the render thread is done with it
+    }
+    this->notify_changed();
+}
+
+// Adds the effect and everything it draws to effects
+static void collect_effects(const ChromaEffect* effect, std::unordered_set<const ChromaEffect*>& effects) {
+    if (effect == nullptr || !effects.insert(effect).second)
+        return;
+    for (const ChromaEffect* child : effect->get_children())
+        collect_effects(child, effects);
+}
+
+void ChromaOutput::get_effects(std::unordered_set<const ChromaEffect*>& effects) const {
+    std::lock_guard<std::mutex> guard(this->layers_lock);
+    for (const ChromaLayer& layer : *this->layers.get())
+        collect_effects(layer.effect.get(), effects);
+}
+
+void ChromaOutput::set_blend_mode(BlendMode mode) {
+    {
+        std::lock_guard<std::mutex> guard(this->layers_lock);
+        LayerStack* layers = new LayerStack(*this->layers.get());
+        (*layers)[this->current_layer].blend_mode = mode;
+        this->layers.publish(layers);
+    }
+    this->notify_changed();
+}
+
+void ChromaOutput::set_update_rate(float rate) {
+    {
+        std::lock_guard<std::mutex> guard(this->layers_lock);
+        LayerStack* layers = new LayerStack(*this->layers.get());
+        (*layers)[this->current_layer].update_rate = rate;
+        this->layers.publish(layers);
+    }
+    this->notify_changed();
+}
+
+void ChromaOutput::set_resolution(float resolution, Interpolation interpolation) {
+    {
+        std::lock_guard<std::mutex> guard(this->layers_lock);
+        LayerStack* layers = new LayerStack(*this->layers.get());
+        ChromaLayer& layer = (*layers)[this->current_layer];
+        layer.resolution = resolution;
+        layer.interpolation = interpolation;
+        layer.cache = std::make_shared<LayerCache>(); // Cached pixels were drawn at the old resolution
+        layer.samples = std::make_shared<LayerSamples>();
+        layer.bake = std::make_shared<LayerBake>();
+        this->layers.publish(layers);
+    }
+    this->notify_changed();
+}
+
+void ChromaOutput::set_bake_period(float period) {
+    {
+        std::lock_guard<std::mutex> guard(this->layers_lock);
+        LayerStack* layers = new LayerStack(*this->layers.get());
+        ChromaLayer& layer = (*layers)[this->current_layer];
+        layer.bake_period = period;
+        layer.bake = std::make_shared<LayerBake>();
+        this->layers.publish(layers); // A ring no longer used is freed here
+    }
+    this->notify_changed();
+}
 
-    while (this->running) {
-        double curr_time = get_now();
-        double delta_time = curr_time - start_time;
-        start_time = curr_time;
-        
-        state.delta_time = delta_time / 1e6;
-        state.time += delta_time / 1e6;
+void ChromaOutput::add_layer() {
+    {
+        std::lock_guard<std::mutex> guard(this->layers_lock);
+        LayerStack* layers = new LayerStack(*this->layers.get());
+        layers->push_back(new_layer());
+        find_shared_effects(*layers);
+        this->layers.publish(layers);
+    }
+    this->notify_changed();
+}
+
+bool ChromaOutput::set_current_layer(size_t index) {
+    std::lock_guard<std::mutex> guard(this->layers_lock);
+    if (index >= this->layers.get()->size())
+        return false;
+    this->current_layer = index;
+    return true;
+}
+
+double ChromaOutput::render(RenderPool& pool, const ChromaState& output_state, ChromaFrame& frame, bool compiled) {
+    std::shared_ptr<const PixelLayout> layout = std::atomic_load(&this->layout);
+    ChromaState state = output_state;
+    state.layout = layout.get();
+    size_t pixel_length = this->pixel_length;
+    bool half_caches = this->cache_format == PIXEL_HALF;
+    bool profiling = this->profiling && this->profiler.sample();
+    const LayerStack& layers = *this->layers.enter();
+    state.frame = next_frame++;
+    state.shared = layers.empty() ? nullptr : layers[0].shared.get();
+    if (layout != this->rendered_layout || state.quality.level != this->rendered_quality) {
+        // Pixels drawn for the old positions or at another quality are stale, even for layers that report unchanged output
+        for (const ChromaLayer& layer : layers) {
+            layer.cache->valid = false;
+            layer.keyframes->valid = false;
+            layer.samples->probe_time = -INFINITY;
+            *layer.bake = LayerBake();
+        }
+        this->rendered_layout = layout;
+        this->rendered_quality = state.quality.level;
+    }
+    size_t bake_memory = 0;
+    for (const ChromaLayer& layer : layers)
+        bake_memory += get_ring_bytes(*layer.bake, pixel_length);
+    int64_t bake_ns = 0;
+    size_t top = 0;
+    for (size_t l = 0; l < layers.size(); l++) {
+        if (layers[l].effect != nullptr)
+            top = l;
+    }
+    int64_t tick_start = get_monotonic_ns();
+    for (size_t l = 0; l < layers.size(); l++) {
+        const ChromaLayer& layer = layers[l];
+        if (layer.effect == nullptr)
+            continue;
+        if (this->update_bake(pool, l, layer, state, compiled, bake_memory, bake_ns))
+            continue;
+        if (this->update_keyframes(layer, state, l < top)) {
+            LayerKeyframes& keys = *layer.keyframes;
+            if (!keys.drawing)
+                continue;
+            tick_layer(this->profiler, profiling, l, *layer.effect, keys.state);
+            keys.next.resize(pixel_length);
+            keys.filled = 0;
+            if (compiled) {
+                layer.program->compile(*layer.effect, keys.state);
+                layer.program->set_profiling(profiling);
+            }
+            else {
+                layer.program->clear();
+                layer.program->set_tree_profiling(profiling ? &this->profiler : nullptr, l);
+            }
+            draw_layer_samples(pool, layer, keys.state);
+            continue;
+        }
+
+        tick_layer(this->profiler, profiling, l, *layer.effect, state);
+
+        // Reuse the layer's last pixels until its effect reports they may have changed
+        LayerCache& cache = *layer.cache;
+        // Time can move backwards on a virtual clock, the pixels are only known to hold from the fill on
+        if (cache.valid && state.time >= cache.since && state.time < cache.until)
+            continue;
+        ChromaStability stability = layer.effect->get_stability(state);
+        cache.valid = false;
+        cache.filling = stability.variance != TIME_VARYING_OUTPUT && state.time < stability.until;
+        if (cache.filling) {
+            cache.half = half_caches;
+            if (cache.half) {
+                cache.half_pixels.resize(pixel_length * 4);
+                std::vector<vec4>().swap(cache.pixels);
+            }
+            else {
+                cache.pixels.resize(pixel_length);
+                std::vector<uint16_t>().swap(cache.half_pixels);
+            }
+            cache.filled = 0;
+            cache.tiles.assign((pixel_length + COMPOSITOR_TILE - 1) / COMPOSITOR_TILE, false);
+            cache.since = state.time;
+            cache.until = stability.until;
+        }
+
+        if (compiled) {
+            layer.program->compile(*layer.effect, state);
+            layer.program->set_profiling(profiling);
+        }
+        else {
+            layer.program->clear();
+            layer.program->set_tree_profiling(profiling ? &this->profiler : nullptr, l);
+        }
+        draw_layer_samples(pool, layer, state);
+    }
+
+    // Frames drawn for baked loops count as drawing
+    this->record_stage_time(STAGE_TICK, get_monotonic_ns() - tick_start - bake_ns);
+
+    frame.resize(this->frame_format, pixel_length);
+    std::shared_ptr<const GammaTable> gamma = std::atomic_load(&this->gamma);
+
+    // Stage times are summed over the spans, so with several threads they add up to more than the frame took
+    std::atomic<int64_t> draw_ns = bake_ns;
+    std::atomic<int64_t> composite_ns = 0;
+    std::atomic<int64_t> packetize_ns = 0;
+    // CHROMA_SPAN_MAX pixels of vec4 is a whole number of cache lines
+    pool.parallel_for(pixel_length, CHROMA_SPAN_MAX, [&](size_t start, size_t end){
+        int64_t span_start = get_monotonic_ns();
+        int64_t span_draw_ns = 0;
+        float indices[CHROMA_SPAN_MAX];
+        for (size_t i = start; i < end; i++)
+            indices[i - start] = static_cast<float>(i) / pixel_length;
+        if (frame.format != PIXEL_BYTE) {
+            composite_layers(layers, indices, frame.pixels.data() + start, start, end - start, state, &span_draw_ns);
+            draw_ns += span_draw_ns;
+            composite_ns += get_monotonic_ns() - span_start - span_draw_ns;
+            return;
+        }
+        // Quantize while the span is still in cache, only bytes reach the frame
+        vec4 pixels[CHROMA_SPAN_MAX];
+        composite_layers(layers, indices, pixels, start, end - start, state, &span_draw_ns);
+        int64_t quantize_start = get_monotonic_ns();
+        gamma->apply(frame.bytes.data() + start * 4, &pixels[0].x, (end - start) * 4);
+        draw_ns += span_draw_ns;
+        composite_ns += quantize_start - span_start - span_draw_ns;
+        packetize_ns += get_monotonic_ns() - quantize_start;
+    });
+    this->record_stage_time(STAGE_DRAW, draw_ns);
+    this->record_stage_time(STAGE_COMPOSITE, composite_ns);
+    if (frame.format == PIXEL_BYTE)
+        this->record_stage_time(STAGE_PACKETIZE, packetize_ns);
+
+    if (profiling) {
+        for (size_t l = 0; l < layers.size(); l++) {
+            ChromaProgram* program = layers[l].program.get();
+            program->set_tree_profiling(nullptr, l);
+            if (!program->is_profiling())
+                continue;
+            program->add_draw_times(this->profiler, l);
+            program->set_profiling(false);
+        }
+        this->profiler.end_frame();
+    }
+
+    double until = INFINITY;
+    for (auto& layer : layers) {
+        LayerKeyframes& keys = *layer.keyframes;
+        if (keys.drawing) {
+            keys.drawing = false;
+            keys.valid = keys.filled == pixel_length;
+        }
+        if (layer.cache->filling) {
+            layer.cache->filling = false;
+            layer.cache->valid = layer.cache->filled == pixel_length;
+        }
+        if (layer.effect != nullptr)
+            until = layer.cache->valid ? std::min(until, layer.cache->until) : state.time;
+    }
+    this->layers.exit();
+    return until;
+}
+
+bool ChromaOutput::update_bake(RenderPool& pool, size_t l, const ChromaLayer& layer, const ChromaState& state, bool compiled, size_t& memory,
+    int64_t& draw_ns) {
+    LayerBake& bake = *layer.bake;
+    bake.active = false;
+    if (layer.bake_period == LAYER_BAKE_OFF)
+        return false;
+    size_t pixel_length = this->pixel_length;
+    if (bake.frames > 0 && state.time < bake.start) {
+        // Start over after a seek back, the effect is only ticked forwards
+        memory -= get_ring_bytes(bake, pixel_length);
+        bake.frames = 0;
+    }
+    if (bake.frames == 0) {
+        double period = layer.bake_period > 0 ? layer.bake_period : layer.effect->get_period(state);
+        if (period == 0)
+            return false; // Constant, the layer cache already draws it only once
+        if (!std::isfinite(period) || period < 0) {
+            // Checked again every frame, effects like fades repeat once they finish
+            if (!bake.waiting)
+                fprintf(stderr, "Output %s layer %zu does not repeat yet, drawing it live\n", this->get_component_id().c_str(), l);
+            bake.waiting = true;
+            return false;
+        }
+        bake.half = this->cache_format == PIXEL_HALF;
+        bake.frames = std::max<size_t>(1, std::lround(period * this->fps));
+        size_t bytes = get_ring_bytes(bake, pixel_length);
+        if (memory + bytes > this->bake_memory) {
+            // Checked again every frame, the bake memory may be raised or other layers may free theirs
+            if (!bake.failed)
+                fprintf(stderr, "Output %s layer %zu needs %.1f MB to bake a %.2f s loop, over the bake memory, drawing it live\n",
+                    this->get_component_id().c_str(), l, bytes / 1048576.0, period);
+            bake.frames = 0;
+            bake.failed = true;
+            return false;
+        }
+        bake.failed = false;
+        memory += bytes;
+        if (bake.half) {
+            bake.half_pixels.resize(bake.frames * pixel_length * 4);
+            std::vector<vec4>().swap(bake.pixels);
+        }
+        else {
+            bake.pixels.resize(bake.frames * pixel_length);
+            std::vector<uint16_t>().swap(bake.half_pixels);
+        }
+        bake.period = period;
+        bake.start = state.time;
+        bake.next = 0;
+        bake.baked = 0;
+        bake.drawn.assign(bake.frames, false);
+    }
 
-        for (auto& effect : this->layers) {
-            if (effect == nullptr)
+    double interval = bake.period / bake.frames;
+    size_t live = std::lround((state.time - bake.start) / interval);
+    if (bake.baked < bake.frames) {
+        int64_t draw_start = get_monotonic_ns();
+        // Frames skipped over are drawn on the next lap, so the effect is still ticked forwards only
+        bake.next = std::max(bake.next, live);
+        for (size_t count = 0; count < BAKE_FRAMES_PER_FRAME && bake.baked < bake.frames; bake.next++) {
+            size_t slot = bake.next % bake.frames;
+            if (bake.drawn[slot])
                 continue;
-            effect->tick(state);
+            ChromaState frame_state = state;
+            frame_state.time = bake.start + bake.next * interval;
+            frame_state.delta_time = interval;
+            frame_state.frame = next_frame++;
+            tick_layer(this->profiler, false, l, *layer.effect, frame_state);
+            if (compiled)
+                layer.program->compile(*layer.effect, frame_state);
+            else
+                layer.program->clear();
+            draw_layer_samples(pool, layer, frame_state);
+            draw_bake_frame(pool, layer, bake, slot, frame_state);
+            bake.drawn[slot] = true;
+            bake.baked++;
+            count++;
         }
-        
-        std::vector<std::future<bool>> futures;
-        for (size_t i = 0; i < pixel_length; i++) {
-            // TODO: refactor?
-            float index = static_cast<float>(i) / pixel_length;
-            std::packaged_task<bool()> task([i, index, this, &state, &pixels](){
-                float factor = 1;
-                vec4 total_color;
-                for (int j = this->layers.size() - 1; j >= 0; j--) {
-                    auto& effect = this->layers[j];
-                    if (effect == nullptr)
-                        continue;
-                    vec4 color = effect->draw(index, state); 
-                    total_color += color * factor;
-                    factor *= 1 - color.w;
-                }
-                pixels[i] = total_color;
-                return true;
-            });
-            futures.push_back(boost::asio::post(pool, std::move(task)));
+        if (bake.baked == bake.frames)
+            fprintf(stderr, "Output %s layer %zu baked a %.2f s loop of %zu frames\n", this->get_component_id().c_str(), l, bake.period, bake.frames);
+        draw_ns += get_monotonic_ns() - draw_start;
+    }
+
+    bake.playing = live % bake.frames;
+    if (!bake.drawn[bake.playing])
+        return false; // Only after the clock jumps back within the loop, drawn live until baking passes it again
+    bake.active = true;
+    LayerKeyframes& keys = *layer.keyframes;
+    keys.active = false;
+    keys.valid = false;
+    layer.cache->valid = false;
+    layer.cache->filling = false;
+    return true;
+}
+
+bool ChromaOutput::update_keyframes(const ChromaLayer& layer, const ChromaState& state, bool background) {
+    LayerKeyframes& keys = *layer.keyframes;
+    float rate = layer.update_rate == LAYER_RATE_AUTO ? layer.effect->get_update_rate(state) : layer.update_rate;
+    // Layers that never change on their own are left to the layer cache
+    float background_rate = state.quality.background_rate;
+    if (background && background_rate > 0 && layer.effect->get_update_rate(state) > 0)
+        rate = rate > 0 ? std::min(rate, background_rate) : background_rate;
+    keys.active = rate > 0 && rate < this->fps;
+    keys.drawing = false;
+    if (!keys.active) {
+        keys.valid = false;
+        return false;
+    }
+    layer.cache->valid = false;
+    layer.cache->filling = false;
+
+    double interval = 1 / rate;
+    if (!keys.valid || state.time < keys.previous_time || state.time >= keys.next_time + interval) {
+        // Start over from a single keyframe at the current time, like after a seek or a skipped update
+        keys.state = state;
+        keys.previous_time = state.time;
+        keys.next_time = state.time;
+        keys.drawing = true;
+    }
+    else if (state.time >= keys.next_time) {
+        // Draw the next keyframe ahead of time, the effect is ticked at the keyframe times only
+        keys.previous.swap(keys.next);
+        keys.previous_time = keys.next_time;
+        keys.next_time += interval;
+        keys.state = state;
+        keys.state.time = keys.next_time;
+        keys.state.delta_time = interval;
+        keys.drawing = true;
+    }
+    keys.blend = keys.next_time > keys.previous_time ? (state.time - keys.previous_time) / (keys.next_time - keys.previous_time) : 1;
+    return true;
+}
+
+bool ChromaController::set_component_id(const std::string& id) {
+    std::lock_guard<std::mutex> guard(this->outputs_lock);
+    std::shared_ptr<ChromaOutput> current = this->get_current();
+    for (auto& output : this->outputs) {
+        if (output != current && output->get_component_id() == id)
+            return false;
+    }
+    current->set_component_id(id);
+    return true;
+}
+
+bool ChromaController::add_output(const std::string& component_id, size_t pixel_length, int fps) {
+    std::lock_guard<std::mutex> guard(this->outputs_lock);
+    for (auto& output : this->outputs) {
+        if (output->get_component_id() == component_id)
+            return false;
+    }
+    auto output = std::make_shared<ChromaOutput>(component_id, pixel_length, fps);
+    output->set_profiling(this->profiling);
+    this->outputs.push_back(output);
+    std::atomic_store(&this->current_output, output);
+    if (this->running)
+        this->output_threads.emplace_back([this, output](){ this->run_output(output); });
+    return true;
+}
+
+void ChromaController::set_effect(const std::shared_ptr<ChromaEffect>& effect) {
+    // Held so no other output can take a part of the effect between the check and the set
+    std::lock_guard<std::mutex> guard(this->outputs_lock);
+    std::shared_ptr<ChromaOutput> current = this->get_current();
+    std::unordered_set<const ChromaEffect*> used;
+    for (auto& output : this->outputs) {
+        if (output != current)
+            output->get_effects(used);
+    }
+    std::unordered_set<const ChromaEffect*> drawn;
+    collect_effects(effect.get(), drawn);
+    for (const ChromaEffect* part : drawn) {
+        if (used.count(part) > 0)
+            throw ChromaRuntimeException("That effect is already drawn on another output, give each output its own effects");
+    }
+    current->set_effect(effect);
+}
+
+bool ChromaController::set_current_output(const std::string& component_id) {
+    std::lock_guard<std::mutex> guard(this->outputs_lock);
+    for (auto& output : this->outputs) {
+        if (output->get_component_id() == component_id) {
+            std::atomic_store(&this->current_output, output);
+            return true;
         }
+    }
+    return false;
+}
+
+std::shared_ptr<RenderPool> ChromaController::get_pool() {
+    std::lock_guard<std::mutex> guard(this->pool_lock);
+    size_t num_threads = this->num_threads;
+    if (this->pool == nullptr || this->pool->get_num_threads() != std::max(num_threads, (size_t) 1)) {
+        this->pool = std::make_shared<RenderPool>(num_threads); // Outputs still on the old pool keep it alive
+        this->pool_realtime_version = 0; // New workers have the default settings
+    }
+    int realtime_version = this->realtime_version;
+    if (realtime_version != this->pool_realtime_version) {
+        this->pool_realtime_version = realtime_version;
+        RealtimeConfig realtime = this->get_realtime();
+        this->pool->for_each_worker([&](size_t i, std::thread& worker){
+            apply_realtime(realtime, realtime.worker_cpu >= 0 ? realtime.worker_cpu + static_cast<int>(i) : -1, worker.native_handle());
+        });
+    }
+    return this->pool;
+}
+
+void ChromaController::run_sender(ChromaOutput& output, FramePipeline& pipeline) {
+    // Threads start with the default settings, so there is nothing to apply until real-time settings are first set
+    if (this->realtime_version != 0) {
+        RealtimeConfig realtime = this->get_realtime();
+        apply_realtime(realtime, realtime.send_cpu);
+    }
+
+    size_t index;
+    while (pipeline.wait_pop(pipeline.ready, index, [&](){ return pipeline.sending.load(); })) {
+        int64_t send_start = get_monotonic_ns();
+        if (!pipeline.failed && this->callback(output, pipeline.buffers[index]) != 0)
+            pipeline.failed = true;
+        int64_t send_ns = get_monotonic_ns() - send_start;
+        output.record_send_time(send_ns / 1e3);
+        output.record_stage_time(STAGE_SEND, send_ns);
+        pipeline.push(pipeline.free, index);
+    }
+}
 
-        for (auto& future : futures) {
-            future.wait();
+void ChromaController::run_output(std::shared_ptr<ChromaOutput> output) {
+    FramePacer pacer(output->get_fps(), this->frame_policy);
+    QualityGovernor governor(output->get_fps());
+    int realtime_version = 0; // Threads start with the default settings of version 0
+
+    ChromaState state;
+    state.pixel_length = output->get_pixel_length();
+    uint64_t frame = 0;
+    std::shared_ptr<ChromaClock> clock;
+    int64_t last_time_ns = 0;
+
+    FramePipeline pipeline;
+    for (size_t i = 0; i < PIPELINE_BUFFERS; i++)
+        pipeline.free.push(i);
+    auto stop_sender = [&pipeline](){
+        if (!pipeline.sender.joinable())
+            return;
+        pipeline.sending = false;
+        pipeline.wake();
+        pipeline.sender.join();
+    };
+
+    pacer.start();
+
+    while (this->running && !pipeline.failed) {
+        if (realtime_version != this->realtime_version) {
+            realtime_version = this->realtime_version;
+            RealtimeConfig realtime = this->get_realtime();
+            apply_realtime(realtime, realtime.render_cpu);
+            stop_sender(); // Restarted below with the new settings
+        }
+        pacer.set_policy(this->frame_policy);
+
+        bool pipelined = this->pipelined;
+        if (pipelined && !pipeline.sender.joinable()) {
+            pipeline.sending = true;
+            pipeline.sender = std::thread([this, output, &pipeline](){ this->run_sender(*output, pipeline); });
+        }
+        else if (!pipelined)
+            stop_sender();
+
+        int64_t frame_start = get_monotonic_ns();
+        std::shared_ptr<ChromaClock> current_clock = this->get_clock();
+        if (current_clock != clock) {
+            clock = current_clock;
+            frame = 0;
+            last_time_ns = clock->get_time_ns(frame, output->get_fps());
+        }
+        int64_t time_ns = clock->get_time_ns(frame++, output->get_fps());
+        state.delta_time = (time_ns - last_time_ns) / 1e9;
+        state.time = time_ns / 1e9;
+        last_time_ns = time_ns;
+
+        bool governed = this->governed;
+        if (!governed && governor.get_level() != 0) {
+            governor.reset();
+            output->set_quality_level(0);
+        }
+        governor.set_knobs(this->governor_knobs);
+        state.quality = governed ? governor.get_quality() : ChromaQuality();
+
+        // Wait for the sender to hand back a buffer, only blocks when sending is slower than rendering
+        size_t index;
+        pipeline.wait_pop(pipeline.free, index, [](){ return true; });
+
+        uint64_t version = output->get_version();
+        double until = output->render(*this->get_pool(), state, pipeline.buffers[index], this->compiled);
+
+        if (pipelined)
+            pipeline.push(pipeline.ready, index);
+        else {
+            int64_t send_start = get_monotonic_ns();
+            if (this->callback(*output, pipeline.buffers[index]) != 0)
+                pipeline.failed = true; //TODO: do error handling
+            int64_t send_ns = get_monotonic_ns() - send_start;
+            output->record_send_time(send_ns / 1e3);
+            output->record_stage_time(STAGE_SEND, send_ns);
+            pipeline.free.push(index);
+        }
+        int64_t frame_ns = get_monotonic_ns() - frame_start;
+        output->record_frame_time(frame_ns / 1e3, pipelined);
+        int level = governor.get_level();
+        if (governed && governor.record(frame_ns)) {
+            fprintf(stderr, "Output %s quality level %d -> %d at %.0f%% of the frame budget\n",
+                output->get_component_id().c_str(), level, governor.get_level(), governor.get_load() * 100);
+            output->set_quality_level(governor.get_level());
+        }
+
+        int64_t sleep_start = get_monotonic_ns();
+        pacer.wait();
+        output->set_frame_stats(pacer.get_stats());
+
+        // Nothing will change before the next frame, sleep until a layer changes, the output
+        // changes on its own or a keepalive frame is due
+        float period = 1.0f / output->get_fps();
+        if (this->idle_enabled && this->running && clock->is_realtime() && until - state.time > period) {
+            int64_t now = get_monotonic_ns();
+            int64_t keepalive_ns = std::max(this->keepalive.load(), period) * 1e9;
+            int64_t until_ns = std::min((until - state.time) * 1e9, 1e18);
+            output->set_idle(true);
+            output->wait_for_change(version, now + std::min(keepalive_ns, until_ns));
+            output->set_idle(false);
+            pacer.start(); // Realign deadlines so the idle time does not count as missed frames
         }
+        output->record_stage_time(STAGE_SLEEP, get_monotonic_ns() - sleep_start);
+    }
+    stop_sender();
 
-        if (callback(pixels) != 0)
-            return; //TODO: do error handling
+    // Like a single device before, a device that stops taking frames stops the controller
+    if (pipeline.failed) {
+        fprintf(stderr, "Output %s failed to send a frame, stopping\n", output->get_component_id().c_str());
+        this->stop();
+    }
+}
 
-        usleep(us_per_frame);
+void ChromaController::run(ChromaOutputCallback callback) {
+    this->callback = callback;
+    {
+        std::lock_guard<std::mutex> guard(this->outputs_lock);
+        this->running = true;
+        for (auto& output : this->outputs) {
+            this->output_threads.emplace_back([this, output](){ this->run_output(output); });
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(this->run_lock);
+        this->stopped.wait(guard, [this](){ return !this->running; });
     }
-    pool.join();
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> guard(this->outputs_lock);
+        threads.swap(this->output_threads);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+int ChromaController::render_offline(ChromaOutput& output, size_t frames, ChromaOutputCallback callback) {
+    ChromaState state;
+    state.pixel_length = output.get_pixel_length();
+    SteppedClock clock;
+
+    ChromaFrame frame;
+    double until = -INFINITY;
+    for (size_t i = 0; i < frames; i++) {
+        state.time = clock.get_time_ns(i, output.get_fps()) / 1e9;
+        state.delta_time = i == 0 ? 0 : state.time - clock.get_time_ns(i - 1, output.get_fps()) / 1e9;
+        // Nothing changes a layer between frames here, so a static output's last frame is written again
+        if (state.time >= until)
+            until = output.render(*this->get_pool(), state, frame, this->compiled);
+        if (callback(output, frame) != 0)
+            return 1;
+    }
+    return 0;
 }
 
-void ChromaController::run(int fps, size_t pixel_length, DiscoMaster& disco) { //TODO: Maybe use a generic injection instead of DiscoMaster?
-    this->run(fps, pixel_length, [&](const std::vector<vec4>& pixels){
-        if (disco.write(this->component_id, pixels)) {
+void ChromaController::run(DiscoMaster& disco) { //TODO: Maybe use a generic injection instead of DiscoMaster?
+    this->run([&](const ChromaOutput& output, const ChromaFrame& frame){
+        int result;
+        if (frame.format == PIXEL_BYTE)
+            result = disco.write(output.get_component_id(), frame.bytes.data(), frame.size());
+        else
+            result = disco.write(output.get_component_id(), frame.pixels);
+        if (result) {
             return -1;
         }
         return 0;
     });
-}
\ No newline at end of file
+}
@@ -5,14 +5,31 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <unistd.h>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include <boost/variant/variant.hpp>
 #include <boost/variant/get.hpp>
 
 #include "chromatic.hpp"
+#include "clock.hpp"
 #include "disco.hpp"
+#include "frame_pacer.hpp"
+#include "governor.hpp"
+#include "kernels.hpp"
+#include "layout.hpp"
+#include "metrics.hpp"
+#include "profiler.hpp"
+#include "render_pool.hpp"
+#include "snapshot.hpp"
+
+#define CHROMA_SPAN_MAX 256
 
 class ChromaRuntimeException;
 class ChromaObject;
@@ -21,6 +38,8 @@ class ChromaFunction;
 class ChromaEnvironment;
 class ChromaController;
 class DiscoMaster;
+class ChromaProgram;
+class SharedEffects;
 
 class ChromaRuntimeException : public std::exception {
     private:
@@ -40,12 +59,40 @@ struct ChromaState {
     public:
         int pixel_length;
         float delta_time;
-        float time;
-        float get_time_diff(float prev) const { 
+        double time; // Seconds, double so animations keep sub-millisecond precision after days of uptime
+        ChromaQuality quality;
+        // Where the output's pixels are, look up the pixel an index is drawn at with PixelLayout::get_pixel.
+        // Set while rendering, null for effects drawn outside an output.
+        const PixelLayout* layout = nullptr;
+        uint64_t frame = 0; // Numbers every rendered frame across the outputs, 0 outside an output
+        const SharedEffects* shared = nullptr; // Effects of the output's layers reached more than once, null if none
+        double get_time_diff(double prev) const { 
             return time - prev;
         }
 };
 
+enum ChromaVariance {
+    CONSTANT_OUTPUT,     // Same pixels every frame
+    PIECEWISE_OUTPUT,    // Same pixels until a known time
+    TIME_VARYING_OUTPUT  // Pixels may change every frame
+};
+
+struct ChromaStability {
+    ChromaVariance variance;
+    double until; // Time the output may next change, infinite for constant output
+    static ChromaStability constant() { return {CONSTANT_OUTPUT, INFINITY}; }
+    static ChromaStability varying() { return {TIME_VARYING_OUTPUT, -INFINITY}; }
+    static ChromaStability piecewise(double until) { return {PIECEWISE_OUTPUT, until}; }
+    // Stability of an effect made from both, it changes whenever either changes
+    ChromaStability combine(const ChromaStability& other) const {
+        if (this->variance == TIME_VARYING_OUTPUT || other.variance == TIME_VARYING_OUTPUT)
+            return varying();
+        if (this->variance == CONSTANT_OUTPUT && other.variance == CONSTANT_OUTPUT)
+            return constant();
+        return piecewise(std::min(this->until, other.until));
+    }
+};
+
 class ChromaObject {
     private:
         std::string obj_typename;
@@ -62,7 +109,28 @@ class ChromaEffect : public ChromaObject {
         ChromaEffect(const std::string& sub_typename) : ChromaObject(sub_typename + "Effect") { }
         virtual ~ChromaEffect() { }
         virtual void tick(const ChromaState& state) { }
+        // Effects tick their children through this so the profiler can time each node
+        static void tick_child(ChromaEffect& child, const ChromaState& state);
+        // Effects draw spans of their children through this so a child shared by several parents is drawn once
+        static void draw_child(const ChromaEffect& child, const float* indices, vec4* out, size_t n, const ChromaState& state);
+        // Effects this one ticks and draws, used to find effects shared between parents
+        virtual std::vector<const ChromaEffect*> get_children() const { return {}; }
+        // Called after tick, lets the controller reuse the last rendered pixels while the output is unchanged
+        virtual ChromaStability get_stability(const ChromaState& state) const { return ChromaStability::varying(); }
+        // Updates per second the effect needs to look smooth when the frames in between are interpolated,
+        // infinite if every frame must be drawn and 0 if it never changes on its own
+        virtual float get_update_rate(const ChromaState& state) const { return INFINITY; }
+        // Seconds after which the effect's output repeats exactly, 0 if it never changes on its own and infinite if it never repeats
+        virtual double get_period(const ChromaState& state) const { return INFINITY; }
         virtual vec4 draw(float index, const ChromaState& state) const = 0;
+        // Draws n pixels at once, effects should override this to avoid a virtual call per pixel
+        virtual void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+            for (size_t i = 0; i < n; i++)
+                out[i] = this->draw(indices[i], state);
+        }
+        // Called after tick, appends ops drawing the effect at index register indices into color register out.
+        // Effects without their own ops are called through draw_span.
+        virtual void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class ChromaData {
@@ -106,43 +174,501 @@ struct ChromaEnvironment {
     ChromaController* controller;
 };
 
+enum PixelFormat {
+    PIXEL_FLOAT, // vec4, 16 bytes a pixel
+    PIXEL_HALF,  // IEEE half floats, 8 bytes a pixel
+    PIXEL_BYTE   // 8-bit RGBA, 4 bytes a pixel
+};
+
+// A rendered frame, either float pixels or RGBA bytes quantized by the render threads
+struct ChromaFrame {
+    PixelFormat format = PIXEL_FLOAT;
+    std::vector<vec4> pixels;
+    std::vector<uint8_t> bytes;
+    size_t size() const {
+        return this->format == PIXEL_BYTE ? this->bytes.size() / 4 : this->pixels.size();
+    }
+    void resize(PixelFormat format, size_t length) {
+        this->format = format;
+        if (format == PIXEL_BYTE)
+            this->bytes.resize(length * 4);
+        else
+            this->pixels.resize(length);
+    }
+};
+
+// Pixels of a layer kept across frames while its effect reports unchanged output
+struct LayerCache {
+    std::vector<vec4> pixels;
+    std::vector<uint16_t> half_pixels; // Used instead of pixels when half is set
+    bool half = false;
+    double since = 0; // Time the pixels were drawn at
+    double until = 0;
+    bool valid = false;
+    bool filling = false; // Being drawn this frame, valid once the frame is done
+    std::atomic<size_t> filled = 0; // Pixels drawn or skipped under an opaque layer while filling
+    std::vector<uint8_t> tiles; // Tiles holding pixels, skipped tiles are drawn once they show
+};
+
+// Layers are never changed once published, changing one publishes a copy of the whole stack.
+// The cache and program are only touched by the render thread. A new effect gets a new cache,
+// so the cache always holds pixels of the layer's effect.
+// Two frames of a layer updated below the output's frame rate, the frames in between blend them
+struct LayerKeyframes {
+    std::vector<vec4> previous;
+    std::vector<vec4> next;
+    double previous_time = 0;
+    double next_time = 0;
+    bool active = false;  // Drawn from keyframes this frame
+    bool drawing = false; // next is being drawn this frame, at state
+    bool valid = false;   // Both keyframes are completely drawn
+    float blend = 1;      // Weight of next this frame
+    ChromaState state;
+    std::atomic<size_t> filled = 0;
+};
+
+enum Interpolation {
+    INTERPOLATE_LINEAR,
+    INTERPOLATE_CUBIC // Catmull-Rom
+};
+
+// A layer drawn at every step-th pixel only, the pixels in between are interpolated while compositing
+struct LayerSamples {
+    std::vector<vec4> samples; // Pixel min(j * step, pixel_length - 1) for every j
+    size_t step = 1;           // 1 draws every pixel
+    double probe_time = -INFINITY; // Last time the step was measured for LAYER_RESOLUTION_AUTO
+    size_t probed_step = 1;
+};
+
+#define LAYER_RESOLUTION_AUTO 0 // Draw the fewest pixels that interpolate within LAYER_MAX_ERROR
+
+#define LAYER_RATE_FULL 0  // Draw the layer every frame
+#define LAYER_RATE_AUTO -1 // Update at the rate the layer's effect asks for
+
+#define LAYER_BAKE_OFF 0   // Draw the layer live
+#define LAYER_BAKE_AUTO -1 // Bake the period the layer's effect reports
+#define BAKE_MAX_PERIOD 600.0 // Longest loop in seconds found by combining the periods of an effect's children
+#define BAKE_FRAMES_PER_FRAME 2 // Frames of the loop drawn per output frame while baking, so baking stays ahead of playback
+#define BAKE_DEFAULT_MEMORY (64 << 20) // Bytes of baked frames an output keeps at most
+
+// One period of a periodic layer drawn into a ring of frames ahead of playback, then played back instead of drawing the layer.
+// Only touched by the render thread.
+struct LayerBake {
+    bool failed = false;  // The loop did not fit in the bake memory last frame, drawn live until it does
+    bool waiting = false; // The layer does not repeat yet
+    double period = 0;
+    double start = 0;     // Time the first frame of the ring is at
+    size_t frames = 0;    // Frames in the ring, 0 until baking starts
+    size_t next = 0;      // Frame after start drawn next, frame k is at start + k * period / frames and goes in slot k % frames
+    size_t baked = 0;     // Slots drawn, the ring is complete once all are
+    std::vector<bool> drawn;
+    bool half = false;    // Stored in half_pixels instead of pixels
+    std::vector<vec4> pixels;
+    std::vector<uint16_t> half_pixels;
+    bool active = false;  // Played from the ring this frame
+    size_t playing = 0;   // Slot played this frame
+};
+
+struct ChromaLayer {
+    std::shared_ptr<ChromaEffect> effect;
+    BlendMode blend_mode = BLEND_OVER;
+    float update_rate = LAYER_RATE_FULL; // Updates per second, or LAYER_RATE_FULL or LAYER_RATE_AUTO
+    float resolution = 1; // Fraction of the pixels drawn, or LAYER_RESOLUTION_AUTO
+    Interpolation interpolation = INTERPOLATE_LINEAR;
+    float bake_period = LAYER_BAKE_OFF; // Seconds, or LAYER_BAKE_OFF or LAYER_BAKE_AUTO
+    std::shared_ptr<LayerCache> cache = std::make_shared<LayerCache>();
+    std::shared_ptr<LayerKeyframes> keyframes = std::make_shared<LayerKeyframes>();
+    std::shared_ptr<LayerSamples> samples = std::make_shared<LayerSamples>();
+    std::shared_ptr<LayerBake> bake = std::make_shared<LayerBake>();
+    std::shared_ptr<ChromaProgram> program; // Effect compiled for the current frame, drawn through the tree if null or empty
+    std::shared_ptr<const SharedEffects> shared; // Found over the whole stack, the same for every layer of it
+};
+
+typedef std::vector<ChromaLayer> LayerStack;
+
+// A single device driven by the controller, with its own layer stack, size and frame rate
+class ChromaOutput {
+    private:
+        std::string component_id;
+        mutable std::mutex id_lock; // The id is renamed by commands while the render and send threads read it
+        size_t pixel_length;
+        int fps;
+        EpochSnapshot<LayerStack> layers; // Published by commands, read by the render thread without locking
+        size_t current_layer = 0; // Guarded by layers_lock
+        mutable std::mutex layers_lock; // Serializes commands changing the layers, never taken while rendering
+        FramePacerStats frame_stats;
+        FrameTimeHistory frame_times;
+        FrameTimeHistory send_times;
+        bool pipelined_times = false;
+        std::mutex stats_lock;
+        FrameMetrics metrics;
+        EffectProfiler profiler;
+        std::atomic<bool> profiling = false;
+        uint64_t version = 0; // Bumped on every layer change to wake the output from idle
+        std::mutex change_lock;
+        std::condition_variable changed;
+        std::atomic<bool> idle = false;
+        std::atomic<int> quality_level = 0;
+        std::atomic<PixelFormat> frame_format = PIXEL_FLOAT;
+        std::atomic<PixelFormat> cache_format = PIXEL_FLOAT;
+        std::atomic<size_t> bake_memory = BAKE_DEFAULT_MEMORY;
+        std::shared_ptr<const GammaTable> gamma = std::make_shared<GammaTable>();
+        std::shared_ptr<const PixelLayout> layout;
+        std::shared_ptr<const PixelLayout> rendered_layout; // Layout of the last frame, only touched by the render thread
+        int rendered_quality = 0; // Quality level of the last frame, only touched by the render thread
+
+        // Decides whether the layer is drawn from keyframes this frame and which keyframe to draw, if any
+        // Background layers are all but the top one, the quality governor may lower their update rate
+        bool update_keyframes(const ChromaLayer& layer, const ChromaState& state, bool background);
+        // Decides whether the layer is played from its baked loop this frame, drawing the next frames of the loop while it is baked.
+        // Memory is the bytes of the rings of the stack, a new ring is only allocated if it fits.
+        // The time spent drawing the loop is added to draw_ns.
+        bool update_bake(RenderPool& pool, size_t l, const ChromaLayer& layer, const ChromaState& state, bool compiled, size_t& memory,
+            int64_t& draw_ns);
+    public:
+        ChromaOutput(const std::string& component_id, size_t pixel_length, int fps);
+        // Changes to the layers are published as a new stack, the render thread picks it up on its next frame
+        void set_effect(const std::shared_ptr<ChromaEffect>& effect);
+        // Adds every effect the layers draw, with everything those draw, to effects
+        void get_effects(std::unordered_set<const ChromaEffect*>& effects) const;
+        void set_blend_mode(BlendMode mode);
+        // Below the frame rate, the current layer is drawn at rate and interpolated in between
+        void set_update_rate(float rate);
+        // Below 1, the current layer is drawn at that fraction of the pixels and interpolated in between
+        void set_resolution(float resolution, Interpolation interpolation);
+        // Above 0, the current layer is drawn for one period into a ring of frames and then played back from it
+        void set_bake_period(float period);
+        void add_layer();
+        // Returns false if there is no layer at index
+        bool set_current_layer(size_t index);
+        size_t get_num_layers() {
+            std::lock_guard<std::mutex> guard(this->layers_lock);
+            return this->layers.get()->size();
+        }
+        size_t get_current_layer() const {
+            std::lock_guard<std::mutex> guard(this->layers_lock);
+            return this->current_layer;
+        }
+        std::string get_component_id() const {
+            std::lock_guard<std::mutex> guard(this->id_lock);
+            return this->component_id;
+        }
+        void set_component_id(const std::string& id) {
+            std::lock_guard<std::mutex> guard(this->id_lock);
+            this->component_id = id;
+        }
+        size_t get_pixel_length() const {
+            return this->pixel_length;
+        }
+        int get_fps() const {
+            return this->fps;
+        }
+        FramePacerStats get_frame_stats() {
+            std::lock_guard<std::mutex> guard(this->stats_lock);
+            return this->frame_stats;
+        }
+        void set_frame_stats(const FramePacerStats& stats) {
+            std::lock_guard<std::mutex> guard(this->stats_lock);
+            this->frame_stats = stats;
+        }
+        // Frame time is the time the render thread spends on a frame, send time is the time spent in the callback
+        void record_frame_time(double frame_us, bool pipelined) {
+            std::lock_guard<std::mutex> guard(this->stats_lock);
+            if (pipelined != this->pipelined_times) {
+                this->frame_times.clear();
+                this->send_times.clear();
+                this->pipelined_times = pipelined;
+            }
+            this->frame_times.record(frame_us);
+        }
+        void record_send_time(double send_us) {
+            std::lock_guard<std::mutex> guard(this->stats_lock);
+            this->send_times.record(send_us);
+        }
+        std::string get_frame_times() {
+            std::lock_guard<std::mutex> guard(this->stats_lock);
+            return std::string(this->pipelined_times ? "pipelined" : "sequential") +
+                " frame (us) " + this->frame_times.to_string() + ", send (us) " + this->send_times.to_string();
+        }
+        void record_stage_time(FrameStage stage, int64_t ns) {
+            this->metrics.record(stage, ns);
+        }
+        StageSnapshot get_stage_times(FrameStage stage) {
+            return this->metrics.get_snapshot(stage);
+        }
+        // Times every node of the layers on one frame in PROFILE_INTERVAL, enabling clears earlier results
+        void set_profiling(bool enabled) {
+            if (enabled && !this->profiling)
+                this->profiler.clear();
+            this->profiling = enabled;
+        }
+        bool is_profiling() const {
+            return this->profiling;
+        }
+        EffectProfiler& get_profiler() {
+            return this->profiler;
+        }
+        void notify_changed() {
+            std::lock_guard<std::mutex> guard(this->change_lock);
+            this->version++;
+            this->changed.notify_all();
+        }
+        uint64_t get_version() {
+            std::lock_guard<std::mutex> guard(this->change_lock);
+            return this->version;
+        }
+        // Blocks until the layers change from the given version or the CLOCK_MONOTONIC deadline passes
+        void wait_for_change(uint64_t version, int64_t deadline_ns) {
+            std::unique_lock<std::mutex> lock(this->change_lock);
+            auto deadline = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadline_ns));
+            this->changed.wait_until(lock, deadline, [this, version](){ return this->version != version; });
+        }
+        bool is_idle() const {
+            return this->idle;
+        }
+        // PIXEL_BYTE quantizes frames on the render threads so sending them is a straight copy
+        void set_frame_format(PixelFormat format) {
+            this->frame_format = format;
+        }
+        PixelFormat get_frame_format() const {
+            return this->frame_format;
+        }
+        // PIXEL_HALF halves the memory of cached layers, taking effect as they are next redrawn
+        void set_cache_format(PixelFormat format) {
+            this->cache_format = format;
+        }
+        PixelFormat get_cache_format() const {
+            return this->cache_format;
+        }
+        // Baked loops that would take the rings of the output's layers over bytes are drawn live instead
+        void set_bake_memory(size_t bytes) {
+            this->bake_memory = bytes;
+        }
+        size_t get_bake_memory() const {
+            return this->bake_memory;
+        }
+        // Returns false if the layout does not have a position for every pixel
+        bool set_layout(const std::shared_ptr<const PixelLayout>& layout) {
+            if (layout->size() != this->pixel_length)
+                return false;
+            std::atomic_store(&this->layout, layout);
+            this->notify_changed();
+            return true;
+        }
+        std::shared_ptr<const PixelLayout> get_layout() const {
+            return std::atomic_load(&this->layout);
+        }
+        // Gamma is applied while quantizing, so only to PIXEL_BYTE frames
+        void set_gamma(float gamma) {
+            std::atomic_store(&this->gamma, std::shared_ptr<const GammaTable>(std::make_shared<GammaTable>(gamma)));
+        }
+        float get_gamma() const {
+            return std::atomic_load(&this->gamma)->get_gamma();
+        }
+        void set_idle(bool idle) {
+            this->idle = idle;
+        }
+        // Level the quality governor has stepped the output down to, 0 for full quality
+        void set_quality_level(int level) {
+            this->quality_level = level;
+        }
+        int get_quality_level() const {
+            return this->quality_level;
+        }
+        // Ticks every layer then draws and composites them into the frame on the pool, compiling
+        // each layer into a ChromaProgram first if compiled is set.
+        // Returns the time the output may next change, infinite if every layer is constant.
+        double render(RenderPool& pool, const ChromaState& output_state, ChromaFrame& frame, bool compiled = true);
+};
+
+typedef std::function<int(const ChromaOutput&, const ChromaFrame&)> ChromaOutputCallback;
+
+struct FramePipeline;
+
 class ChromaController {
     private:
-        std::string component_id = std::string("disco.local");
-        std::vector<std::shared_ptr<ChromaEffect>> layers = std::vector<std::shared_ptr<ChromaEffect>>({nullptr});
-        size_t current_layer = 0;
-        bool running = false;
+        std::vector<std::shared_ptr<ChromaOutput>> outputs = std::vector<std::shared_ptr<ChromaOutput>>({
+            std::make_shared<ChromaOutput>("disco.local", 150, 60)
+        });
+        std::shared_ptr<ChromaOutput> current_output = outputs[0]; // Swapped by commands, read through get_current
+        std::vector<std::thread> output_threads;
+        ChromaOutputCallback callback;
+        std::mutex outputs_lock;
+        std::atomic<bool> running = false;
+        std::mutex run_lock;              // Orders stop() against run() waiting for it
+        std::condition_variable stopped;
+        std::atomic<size_t> num_threads = std::thread::hardware_concurrency();
+        std::shared_ptr<RenderPool> pool;
+        std::mutex pool_lock;
+        int pool_realtime_version = 0; // Version of the real-time settings the pool's workers run with
+        std::atomic<MissedFramePolicy> frame_policy = SKIP_MISSED;
+        RealtimeConfig realtime;
+        std::mutex realtime_lock;
+        std::atomic<int> realtime_version = 0;
+        std::atomic<bool> pipelined = true;
+        std::atomic<bool> idle_enabled = true;
+        std::atomic<bool> compiled = true;
+        std::atomic<float> keepalive = 1; // Seconds between refresh frames while idle
+        std::atomic<bool> profiling = false;
+        std::shared_ptr<ChromaClock> clock = std::make_shared<MonotonicClock>();
+        std::atomic<bool> governed = false;
+        std::atomic<int> governor_knobs = KNOB_ALL;
+
+        std::shared_ptr<RenderPool> get_pool();
+        std::shared_ptr<ChromaOutput> get_current() {
+            return std::atomic_load(&this->current_output);
+        }
+        void run_output(std::shared_ptr<ChromaOutput> output);
+        void run_sender(ChromaOutput& output, FramePipeline& pipeline);
     public:
         // TODO: return some kind of status?
-        void set_effect(const std::shared_ptr<ChromaEffect>& effect) {
-            this->layers[this->current_layer] = effect;
+        // Throws ChromaRuntimeException if any part of the effect is drawn on another output, outputs render on
+        // their own threads and an effect is only ticked and drawn by one at a time
+        void set_effect(const std::shared_ptr<ChromaEffect>& effect);
+        void set_blend_mode(BlendMode mode) {
+            this->get_current()->set_blend_mode(mode);
+        }
+        void set_update_rate(float rate) {
+            this->get_current()->set_update_rate(rate);
+        }
+        void set_resolution(float resolution, Interpolation interpolation) {
+            this->get_current()->set_resolution(resolution, interpolation);
+        }
+        void set_bake_period(float period) {
+            this->get_current()->set_bake_period(period);
         }
         void add_layer() {
-            this->layers.push_back(nullptr);
+            this->get_current()->add_layer();
         }
-        void set_current_layer(size_t index) {
-            this->current_layer = index;
+        bool set_current_layer(size_t index) {
+            return this->get_current()->set_current_layer(index);
         }
         size_t get_num_layers() {
-            return this->layers.size();
+            return this->get_current()->get_num_layers();
         }
         size_t get_current_layer() {
-            return this->current_layer;
+            return this->get_current()->get_current_layer();
         }
         std::string get_component_id() {
-            return this->component_id;
+            return this->get_current()->get_component_id();
         }
-        void set_component_id(const std::string& id) {
-            this->component_id = id;
+        // Returns false if another output already has the id
+        bool set_component_id(const std::string& id);
+        // Adds an output and makes it current, it starts rendering right away if the controller is running.
+        // Returns false if an output already has the component id.
+        bool add_output(const std::string& component_id, size_t pixel_length, int fps);
+        // Returns false if no output has the given component id
+        bool set_current_output(const std::string& component_id);
+        ChromaOutput& get_current_output() {
+            return *this->get_current(); // Outputs are never removed, the reference stays valid
+        }
+        std::vector<std::shared_ptr<ChromaOutput>> get_outputs() {
+            std::lock_guard<std::mutex> guard(this->outputs_lock);
+            return this->outputs;
+        }
+        // Takes effect on the next frame if the controller is running
+        void set_num_threads(size_t num_threads) {
+            this->num_threads = num_threads;
+        }
+        size_t get_num_threads() {
+            return this->num_threads;
+        }
+        void set_frame_policy(MissedFramePolicy policy) {
+            this->frame_policy = policy;
+        }
+        MissedFramePolicy get_frame_policy() {
+            return this->frame_policy;
+        }
+        // Applied by the render threads at the start of their next frame
+        void set_realtime(const RealtimeConfig& config) {
+            {
+                std::lock_guard<std::mutex> guard(this->realtime_lock);
+                // Process wide, so applied here once rather than by every thread
+                if (config.lock_memory != this->realtime.lock_memory)
+                    apply_memory_lock(config.lock_memory);
+                this->realtime = config;
+                this->realtime_version++;
+            }
+            for (auto& output : this->get_outputs())
+                output->notify_changed(); // Wake idle outputs to apply it
+        }
+        RealtimeConfig get_realtime() {
+            std::lock_guard<std::mutex> guard(this->realtime_lock);
+            return this->realtime;
+        }
+        // Sends frames from a separate thread so the next frame renders while the last one is sent
+        void set_pipelined(bool pipelined) {
+            this->pipelined = pipelined;
+        }
+        bool is_pipelined() {
+            return this->pipelined;
+        }
+        // Draws layers from flat programs compiled every frame instead of walking their effect trees
+        void set_compiled(bool compiled) {
+            this->compiled = compiled;
+        }
+        bool is_compiled() {
+            return this->compiled;
+        }
+        // Lets outputs stop rendering while their layers are static, resending the last frame every keepalive seconds
+        void set_idle(bool enabled, float keepalive) {
+            this->idle_enabled = enabled;
+            this->keepalive = keepalive;
+            for (auto& output : this->get_outputs())
+                output->notify_changed();
+        }
+        bool is_idle_enabled() {
+            return this->idle_enabled;
+        }
+        float get_keepalive() {
+            return this->keepalive;
+        }
+        void set_profiling(bool enabled) {
+            this->profiling = enabled;
+            for (auto& output : this->get_outputs())
+                output->set_profiling(enabled);
+        }
+        bool is_profiling() {
+            return this->profiling;
+        }
+        // Lets outputs lower the given GovernorKnobs while their frames run over budget
+        void set_governor(bool enabled, int knobs) {
+            this->governor_knobs = knobs;
+            this->governed = enabled;
+        }
+        bool is_governed() {
+            return this->governed;
+        }
+        int get_governor_knobs() {
+            return this->governor_knobs;
+        }
+        // Outputs read the time of every frame from the clock, a new clock restarts their frame counts
+        void set_clock(const std::shared_ptr<ChromaClock>& clock) {
+            std::atomic_store(&this->clock, clock);
+            for (auto& output : this->get_outputs())
+                output->notify_changed(); // Wake idle outputs to pick it up
+        }
+        std::shared_ptr<ChromaClock> get_clock() {
+            return std::atomic_load(&this->clock);
         }
         void stop() {
-            this->running = false;
+            {
+                std::lock_guard<std::mutex> guard(this->run_lock);
+                this->running = false;
+            }
+            this->stopped.notify_all();
+            for (auto& output : this->get_outputs())
+                output->notify_changed(); // Wake idle outputs
         }
         bool is_running() {
             return this->running;
         }
-        void run(int fps, size_t pixel_length, std::function<int(const std::vector<vec4>&)> callback);
-        void run(int fps, size_t pixel_length, DiscoMaster& disco);
+        // Renders every output on its own thread until stopped, sharing one render pool
+        void run(ChromaOutputCallback callback);
+        // Renders frames of the output back to back, stepping time by exactly one frame period each,
+        // instead of in real time. Returns non-zero if the callback fails.
+        int render_offline(ChromaOutput& output, size_t frames, ChromaOutputCallback callback);
+        void run(DiscoMaster& disco);
 };
 
 #endif
\ No newline at end of file
@@ -135,7 +135,7 @@ void ChromaCLI::run_stdin() {
     fprintf(stderr, "Starting input thread\n");
     std::thread thread([&](){this->handle_stdin_input();});
     fprintf(stderr, "Starting controller\n");
-    cenv.controller->run(60, 150, this->disco);
+    cenv.controller->run(this->disco);
     thread.join();
 }
 
@@ -0,0 +1,15 @@
+#include "clock.hpp"
+#include "frame_pacer.hpp"
+
+MonotonicClock::MonotonicClock() : start_ns(get_monotonic_ns()) { }
+
+int64_t MonotonicClock::get_time_ns(uint64_t frame, int fps) {
+    return get_monotonic_ns() - this->start_ns;
+}
+
+int64_t SteppedClock::get_time_ns(uint64_t frame, int fps) {
+    if (this->step_ns > 0)
+        return frame * this->step_ns;
+    // Divide last so frame times do not drift from rounding the period
+    return frame * 1000000000 / fps;
+}
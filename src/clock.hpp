@@ -0,0 +1,48 @@
+#ifndef CHROMA_CLOCK_H
+#define CHROMA_CLOCK_H
+
+#include <atomic>
+#include <cstdint>
+
+// Source of the time effects animate with, in nanoseconds
+class ChromaClock {
+    public:
+        virtual ~ChromaClock() { }
+        // Time of an output's next frame, frame is the number of frames the output has rendered so far
+        virtual int64_t get_time_ns(uint64_t frame, int fps) = 0;
+        // Real-time clocks let static outputs idle, other clocks only move from frame to frame
+        virtual bool is_realtime() const { return false; }
+};
+
+// Real time since the clock was created, on CLOCK_MONOTONIC
+class MonotonicClock : public ChromaClock {
+    private:
+        int64_t start_ns;
+    public:
+        MonotonicClock();
+        int64_t get_time_ns(uint64_t frame, int fps);
+        bool is_realtime() const { return true; }
+};
+
+// Time only moves when it is set, for replaying or scrubbing through a scene
+class VirtualClock : public ChromaClock {
+    private:
+        std::atomic<int64_t> time_ns;
+    public:
+        VirtualClock(int64_t time_ns = 0) : time_ns(time_ns) { }
+        int64_t get_time_ns(uint64_t frame, int fps) { return this->time_ns; }
+        void set_time_ns(int64_t time_ns) { this->time_ns = time_ns; }
+        void advance_ns(int64_t delta_ns) { this->time_ns += delta_ns; }
+};
+
+// Every frame is exactly step_ns after the last, or one frame period of its output if step_ns is 0.
+// Outputs render the same frames however fast or slow they run.
+class SteppedClock : public ChromaClock {
+    private:
+        int64_t step_ns;
+    public:
+        SteppedClock(int64_t step_ns = 0) : step_ns(step_ns) { }
+        int64_t get_time_ns(uint64_t frame, int fps);
+};
+
+#endif
@@ -0,0 +1,314 @@
+#include <algorithm>
+
+#include "compositor.hpp"
+#include "program.hpp"
+
+bool parse_blend_mode(const std::string& name, BlendMode& mode) {
+    const std::string names[] = {"over", "add", "multiply", "max", "screen"};
+    for (int i = 0; i < 5; i++) {
+        if (name == names[i]) {
+            mode = static_cast<BlendMode>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string blend_mode_to_string(BlendMode mode) {
+    const std::string names[] = {"over", "add", "multiply", "max", "screen"};
+    return names[mode];
+}
+
+// Both go through the kernels picked for the CPU, vec4 pixels are 4 floats each
+void blend_span(BlendMode mode, vec4* dst, const vec4* src, size_t n) {
+    get_kernels().blend[mode](&dst->x, &src->x, n);
+}
+
+void accumulate_over(vec4* total, float* factors, const vec4* colors, size_t n) {
+    get_kernels().accumulate_over(&total->x, factors, &colors->x, n);
+}
+
+static void draw_effect(const ChromaLayer& layer, const float* indices, vec4* out, size_t n, const ChromaState& state) {
+    if (layer.program != nullptr && layer.program->size() > 0)
+        layer.program->run(indices, out, n, state);
+    else if (layer.program != nullptr && layer.program->get_tree_profiler() != nullptr)
+        profile_draw(*layer.program->get_tree_profiler(), layer.program->get_tree_layer(), *layer.effect, indices, out, n, state);
+    else
+        ChromaEffect::draw_child(*layer.effect, indices, out, n, state);
+}
+
+// Fills pixels offset to offset + n from count samples taken at every step-th pixel, of which samples starts at sample first
+static void interpolate_samples(const vec4* samples, size_t first, size_t count, size_t step, Interpolation interpolation, vec4* out,
+    size_t offset, size_t n, size_t pixel_length) {
+    for (size_t i = 0; i < n; i++) {
+        size_t pixel = offset + i;
+        size_t j = pixel / step;
+        size_t x0 = j * step;
+        size_t x1 = std::min(x0 + step, pixel_length - 1);
+        const vec4& p1 = samples[j - first];
+        if (x1 <= x0) {
+            out[i] = p1;
+            continue;
+        }
+        const vec4& p2 = samples[j + 1 - first];
+        float t = static_cast<float>(pixel - x0) / (x1 - x0);
+        if (interpolation == INTERPOLATE_LINEAR) {
+            out[i] = p1 * (1 - t) + p2 * t;
+            continue;
+        }
+        const vec4& p0 = samples[(j > 0 ? j - 1 : 0) - first];
+        const vec4& p3 = samples[std::min(j + 2, count - 1) - first];
+        float t2 = t * t;
+        float t3 = t2 * t;
+        out[i] = p0 * ((-t + 2 * t2 - t3) / 2) + p1 * ((2 - 5 * t2 + 3 * t3) / 2) + p2 * ((t + 4 * t2 - 3 * t3) / 2) + p3 * ((t3 - t2) / 2);
+    }
+}
+
+// Steps the probe tries, as powers of two from 2 to LAYER_MAX_STEP
+static constexpr size_t log2_step(size_t step) { return step > 1 ? 1 + log2_step(step / 2) : 0; }
+#define PROBE_STEPS log2_step(LAYER_MAX_STEP)
+
+// Marks the steps whose interpolation of pixels start to end of the layer is off by more than LAYER_MAX_ERROR,
+// bit log2(step) of failed. Steps already failed by another span are not tried again, and steps below the largest
+// one the span passes are taken to pass too, as the whole layer's steps are tried from the largest down.
+static void probe_span(const ChromaLayer& layer, const ChromaState& state, size_t start, size_t end, std::atomic<uint32_t>& failed) {
+    vec4 pixels[CHROMA_SPAN_MAX];
+    float indices[CHROMA_SPAN_MAX];
+    size_t pixel_length = state.pixel_length;
+    size_t n = end - start;
+    for (size_t i = 0; i < n; i++)
+        indices[i] = static_cast<float>(start + i) / pixel_length;
+    draw_effect(layer, indices, pixels, n, state);
+
+    // Samples just outside the span, one before and two after for cubic interpolation at every step
+    size_t outside[3 * PROBE_STEPS];
+    vec4 outside_pixels[3 * PROBE_STEPS];
+    size_t n_outside = 0;
+    auto first_sample = [&](size_t step){ return start / step > 0 ? start / step - 1 : 0; };
+    auto last_sample = [&](size_t step){ return std::min((end - 1) / step + 2, (pixel_length + step - 2) / step); };
+    for (size_t step = 2; step <= LAYER_MAX_STEP; step *= 2) {
+        for (size_t j = first_sample(step); j <= last_sample(step); j++) {
+            size_t pixel = std::min(j * step, pixel_length - 1);
+            if ((pixel < start || pixel >= end) && std::find(outside, outside + n_outside, pixel) == outside + n_outside)
+                outside[n_outside++] = pixel;
+        }
+    }
+    for (size_t i = 0; i < n_outside; i++)
+        indices[i] = static_cast<float>(outside[i]) / pixel_length;
+    draw_effect(layer, indices, outside_pixels, n_outside, state);
+
+    vec4 samples[CHROMA_SPAN_MAX / 2 + 4];
+    vec4 interpolated[CHROMA_SPAN_MAX];
+    for (size_t step = LAYER_MAX_STEP; step > 1; step /= 2) {
+        uint32_t bit = 1u << log2_step(step);
+        if (failed.load(std::memory_order_relaxed) & bit)
+            continue;
+        size_t first = first_sample(step);
+        size_t last = last_sample(step);
+        for (size_t j = first; j <= last; j++) {
+            size_t pixel = std::min(j * step, pixel_length - 1);
+            samples[j - first] = pixel >= start && pixel < end ? pixels[pixel - start] :
+                outside_pixels[std::find(outside, outside + n_outside, pixel) - outside];
+        }
+        interpolate_samples(samples, first, (pixel_length + step - 2) / step + 1, step, layer.interpolation, interpolated, start, n, pixel_length);
+        bool passed = true;
+        for (size_t i = 0; i < n && passed; i++) {
+            vec4 d = interpolated[i] + -pixels[i];
+            passed = std::max({std::abs(d.x), std::abs(d.y), std::abs(d.z), std::abs(d.w)}) <= LAYER_MAX_ERROR;
+        }
+        if (passed)
+            return;
+        failed.fetch_or(bit, std::memory_order_relaxed);
+    }
+}
+
+// Largest step whose interpolation of the layer's full resolution pixels stays within LAYER_MAX_ERROR, measured span by span
+// on the pool so probing adds no more to a frame than drawing the layer once
+static size_t probe_step(RenderPool& pool, const ChromaLayer& layer, const ChromaState& state) {
+    static_assert(CHROMA_SPAN_MAX % LAYER_MAX_STEP == 0, "probed spans must start on a sample of every step");
+    std::atomic<uint32_t> failed = 0;
+    pool.parallel_for(state.pixel_length, CHROMA_SPAN_MAX, [&](size_t start, size_t end){
+        probe_span(layer, state, start, end, failed);
+    });
+    for (size_t step = LAYER_MAX_STEP; step > 1; step /= 2) {
+        if (!(failed & (1u << log2_step(step))))
+            return step;
+    }
+    return 1;
+}
+
+void draw_layer_samples(RenderPool& pool, const ChromaLayer& layer, const ChromaState& state) {
+    LayerSamples& samples = *layer.samples;
+    size_t pixel_length = state.pixel_length;
+    if (layer.resolution == LAYER_RESOLUTION_AUTO) {
+        if (state.time < samples.probe_time || state.time >= samples.probe_time + LAYER_PROBE_INTERVAL) {
+            samples.probe_time = state.time;
+            samples.probed_step = probe_step(pool, layer, state);
+        }
+        samples.step = samples.probed_step;
+    }
+    else
+        samples.step = std::lround(1 / layer.resolution);
+    samples.step = std::clamp<size_t>(std::max(samples.step, state.quality.min_step), 1, std::max<size_t>(pixel_length, 1));
+    if (samples.step <= 1 || pixel_length < 2)
+        return;
+
+    // Samples at the same indices the full resolution pixels are drawn at, the last one at the last pixel
+    size_t count = (pixel_length + samples.step - 2) / samples.step + 1;
+    samples.samples.resize(count);
+    pool.parallel_for(count, CHROMA_SPAN_MAX, [&](size_t start, size_t end){
+        float indices[CHROMA_SPAN_MAX];
+        for (size_t i = start; i < end; i++)
+            indices[i - start] = static_cast<float>(std::min(i * samples.step, pixel_length - 1)) / pixel_length;
+        draw_effect(layer, indices, samples.samples.data() + start, end - start, state);
+    });
+}
+
+void draw_pixels(const ChromaLayer& layer, const float* indices, vec4* out, size_t offset, size_t n, const ChromaState& state) {
+    const LayerSamples& samples = *layer.samples;
+    if (samples.step > 1 && state.pixel_length > 1) {
+        interpolate_samples(samples.samples.data(), 0, samples.samples.size(), samples.step, layer.interpolation, out, offset, n, state.pixel_length);
+        return;
+    }
+    draw_effect(layer, indices, out, n, state);
+}
+
+// Blends the layer's keyframes for the tile, drawing the next one first if it is due
+static const vec4* draw_keyframes(LayerKeyframes& keys, const ChromaLayer& layer, const float* indices, vec4* buffer, size_t offset, size_t n) {
+    const vec4* next = keys.next.data() + offset;
+    if (keys.drawing) {
+        draw_pixels(layer, indices, keys.next.data() + offset, offset, n, keys.state);
+        keys.filled += n;
+    }
+    if (keys.blend >= 1)
+        return next;
+    const vec4* previous = keys.previous.data() + offset;
+    float blend = keys.blend;
+    for (size_t i = 0; i < n; i++)
+        buffer[i] = previous[i] * (1 - blend) + next[i] * blend;
+    return buffer;
+}
+
+// Returns the layer's pixels for the tile, either from its baked loop, its cache, its keyframes or drawn into buffer
+static const vec4* draw_layer(const ChromaLayer& layer, const float* indices, vec4* buffer, size_t offset, size_t n, const ChromaState& state) {
+    const LayerBake& bake = *layer.bake;
+    if (bake.active) {
+        size_t pixel = bake.playing * state.pixel_length + offset;
+        if (!bake.half)
+            return bake.pixels.data() + pixel;
+        get_kernels().from_half(&buffer->x, bake.half_pixels.data() + pixel * 4, n * 4);
+        return buffer;
+    }
+    if (layer.keyframes->active)
+        return draw_keyframes(*layer.keyframes, layer, indices, buffer, offset, n);
+    LayerCache& cache = *layer.cache;
+    size_t tile = offset / COMPOSITOR_TILE;
+    if (cache.valid && cache.tiles[tile] && !cache.half)
+        return cache.pixels.data() + offset;
+    if (cache.valid && cache.tiles[tile]) {
+        get_kernels().from_half(&buffer->x, cache.half_pixels.data() + offset * 4, n * 4);
+        return buffer;
+    }
+    // A valid cache still holds until, so a tile skipped while filling is drawn into it once it shows
+    bool storing = cache.filling || cache.valid;
+    if (storing) {
+        if (!cache.half)
+            buffer = cache.pixels.data() + offset;
+        cache.tiles[tile] = true;
+        if (cache.filling)
+            cache.filled += n;
+    }
+    draw_pixels(layer, indices, buffer, offset, n, state);
+    if (storing && cache.half)
+        get_kernels().to_half(cache.half_pixels.data() + offset * 4, &buffer->x, n * 4);
+    return buffer;
+}
+
+// Counts a tile left out under an opaque layer as filled, so a hidden layer can still go idle
+static void skip_layer(const ChromaLayer& layer, size_t n) {
+    if (layer.effect != nullptr && layer.cache->filling)
+        layer.cache->filled += n;
+}
+
+// Draws a layer through draw_layer, adding the time taken to draw_ns if given
+static const vec4* timed_draw_layer(const ChromaLayer& layer, const float* indices, vec4* buffer, size_t offset, size_t n, const ChromaState& state, int64_t* draw_ns) {
+    if (draw_ns == nullptr)
+        return draw_layer(layer, indices, buffer, offset, n, state);
+    int64_t start = get_monotonic_ns();
+    const vec4* colors = draw_layer(layer, indices, buffer, offset, n, state);
+    *draw_ns += get_monotonic_ns() - start;
+    return colors;
+}
+
+static void composite_tile(const std::vector<ChromaLayer>& layers, const float* indices, vec4* out, size_t offset, size_t n, const ChromaState& state,
+    int64_t* draw_ns) {
+    thread_local std::vector<vec4> buffers;
+    float factors[COMPOSITOR_TILE];
+
+    bool all_over = true;
+    for (auto& layer : layers)
+        all_over = all_over && layer.blend_mode == BLEND_OVER;
+
+    if (all_over) {
+        // Front to back, stop as soon as nothing below can show through
+        if (buffers.size() < COMPOSITOR_TILE)
+            buffers.resize(COMPOSITOR_TILE);
+        std::fill(out, out + n, vec4());
+        std::fill(factors, factors + n, 1.0f);
+        for (int j = layers.size() - 1; j >= 0; j--) {
+            if (layers[j].effect == nullptr)
+                continue;
+            const vec4* colors = timed_draw_layer(layers[j], indices, buffers.data(), offset, n, state, draw_ns);
+            accumulate_over(out, factors, colors, n);
+            if (std::all_of(factors, factors + n, [](float f){ return f == 0; })) {
+                for (j--; j >= 0; j--)
+                    skip_layer(layers[j], n);
+                break;
+            }
+        }
+        return;
+    }
+
+    // Mixed blend modes only compose bottom up, so draw top down until an opaque
+    // alpha-over layer covers the tile, then blend upwards from there
+    if (buffers.size() < layers.size() * COMPOSITOR_TILE)
+        buffers.resize(layers.size() * COMPOSITOR_TILE);
+    thread_local std::vector<const vec4*> drawn;
+    drawn.resize(layers.size());
+    bool occluded[COMPOSITOR_TILE] = {false};
+    size_t visible = n;
+    int lowest = layers.size();
+    for (int j = layers.size() - 1; j >= 0 && visible > 0; j--) {
+        if (layers[j].effect == nullptr)
+            continue;
+        const vec4* colors = timed_draw_layer(layers[j], indices, buffers.data() + j * COMPOSITOR_TILE, offset, n, state, draw_ns);
+        drawn[j] = colors;
+        lowest = j;
+        if (layers[j].blend_mode != BLEND_OVER)
+            continue;
+        for (size_t i = 0; i < n; i++) {
+            if (!occluded[i] && colors[i].w >= 1) {
+                occluded[i] = true;
+                visible--;
+            }
+        }
+    }
+
+    for (int j = 0; j < lowest; j++)
+        skip_layer(layers[j], n);
+
+    std::fill(out, out + n, vec4());
+    for (size_t j = lowest; j < layers.size(); j++) {
+        if (layers[j].effect == nullptr)
+            continue;
+        blend_span(layers[j].blend_mode, out, drawn[j], n);
+    }
+}
+
+void composite_layers(const std::vector<ChromaLayer>& layers, const float* indices, vec4* out, size_t offset, size_t n, const ChromaState& state,
+    int64_t* draw_ns) {
+    for (size_t start = 0; start < n; start += COMPOSITOR_TILE) {
+        size_t len = std::min(n - start, (size_t) COMPOSITOR_TILE);
+        composite_tile(layers, indices + start, out + start, offset + start, len, state, draw_ns);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef CHROMA_COMPOSITOR_H
+#define CHROMA_COMPOSITOR_H
+
+#include <string>
+#include <vector>
+
+#include "chroma.hpp"
+#include "chromatic.hpp"
+
+// 128 pixels of vec4 is 2 KB per layer, so a tile of a dozen layers stays in L1
+#define COMPOSITOR_TILE 128
+
+bool parse_blend_mode(const std::string& name, BlendMode& mode);
+std::string blend_mode_to_string(BlendMode mode);
+
+// Blends src onto dst (the layers below) with premultiplied alpha
+void blend_span(BlendMode mode, vec4* dst, const vec4* src, size_t n);
+// Front to back alpha-over: adds colors under what is already in total, scaled by the remaining coverage
+void accumulate_over(vec4* total, float* factors, const vec4* colors, size_t n);
+
+#define LAYER_MAX_ERROR (0.5f / 255) // Largest interpolation error of an automatic resolution layer
+#define LAYER_MAX_STEP 64             // Fewest pixels an automatic resolution layer is drawn at, one in this many
+#define LAYER_PROBE_INTERVAL 1.0      // Seconds between measuring the error of an automatic resolution layer
+
+// Draws the samples of a layer with a resolution below 1 on the pool, after it is ticked and compiled for the frame.
+// A LAYER_RESOLUTION_AUTO layer is drawn at every pixel once every LAYER_PROBE_INTERVAL to find the
+// lowest resolution that interpolates within LAYER_MAX_ERROR.
+void draw_layer_samples(RenderPool& pool, const ChromaLayer& layer, const ChromaState& state);
+
+// Draws the layer's pixels offset to offset + n, interpolating them from its samples if it is drawn below full resolution
+void draw_pixels(const ChromaLayer& layer, const float* indices, vec4* out, size_t offset, size_t n, const ChromaState& state);
+
+// Draws and composites the layers (bottom first) at the given indices into out, tile by tile.
+// Layers hidden under a fully opaque alpha-over layer in a tile are not drawn.
+// Offset is the pixel the span starts at, cached layers are read from and filled at that position.
+// If draw_ns is given, the time spent drawing layers is added to it.
+void composite_layers(const std::vector<ChromaLayer>& layers, const float* indices, vec4* out, size_t offset, size_t n, const ChromaState& state,
+    int64_t* draw_ns = nullptr);
+
+#endif
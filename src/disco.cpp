@@ -5,6 +5,8 @@
 #include <string>
 #include <string_view>
 #include <chrono>
+#include <algorithm>
+#include <stdexcept>
 
 #ifdef _WIN32
 #include <WinSock2.h>
@@ -22,6 +24,7 @@
 using json = nlohmann::json;
 
 #include "disco.hpp"
+#include "kernels.hpp"
 
 struct Packet {
     sockaddr_in addr;
@@ -29,6 +32,24 @@ struct Packet {
     char data[PACKET_MAX];
 };
 
+void to_json(json& j, const DiscoSegment& segment) {
+    j = json{
+        {"start", segment.start},
+        {"length", segment.length},
+        {"offset", segment.offset},
+        {"reverse", segment.reverse}
+    };
+}
+
+void from_json(const json& j, DiscoSegment& segment) {
+    j.at("start").get_to(segment.start);
+    j.at("length").get_to(segment.length);
+    if (j.count("offset") > 0)
+        j.at("offset").get_to(segment.offset);
+    if (j.count("reverse") > 0)
+        j.at("reverse").get_to(segment.reverse);
+}
+
 void to_json(json& j, const DiscoConfig& config) {
     j = json{
         {"controllerID", config.controllerID},
@@ -36,6 +57,13 @@ void to_json(json& j, const DiscoConfig& config) {
         {"discoVersion", config.discoVersion},
         {"address", config.address}
     };
+    if (config.remap != nullptr) {
+        std::vector<int64_t> remap;
+        for (uint32_t index : config.remap->get_gather())
+            remap.push_back(index == DISCO_UNLIT ? -1 : static_cast<int64_t>(index));
+        j["remap"] = remap;
+        j["reverse"] = config.remap->is_reversed();
+    }
 }
 
 void from_json(const json& j, DiscoConfig& config) {
@@ -44,6 +72,59 @@ void from_json(const json& j, DiscoConfig& config) {
     j.at("discoVersion").get_to(config.discoVersion);
     if (j.count("address") > 0)
         j.at("address").get_to(config.address);
+
+    // Either segments or an explicit remap with -1 for dark pixels, either of which can be reversed as a whole
+    std::vector<uint32_t> gather;
+    if (j.count("segments") > 0)
+        gather = DiscoRemap::from_segments(j.at("segments").get<std::vector<DiscoSegment>>());
+    else if (j.count("remap") > 0) {
+        if (j.at("remap").size() > DISCO_MAX_PIXELS)
+            throw std::invalid_argument("remap has more than " + std::to_string(DISCO_MAX_PIXELS) + " pixels");
+        for (int64_t index : j.at("remap").get<std::vector<int64_t>>())
+            gather.push_back(index < 0 || index >= DISCO_UNLIT ? DISCO_UNLIT : static_cast<uint32_t>(index));
+    }
+    bool reverse = j.count("reverse") > 0 && j.at("reverse").get<bool>();
+    if (!gather.empty() || reverse)
+        config.remap = std::make_shared<DiscoRemap>(std::move(gather), reverse);
+}
+
+std::vector<uint32_t> DiscoRemap::from_segments(const std::vector<DiscoSegment>& segments) {
+    // Checked before the table is sized, the segments come straight from a posted config
+    std::vector<const DiscoSegment*> sorted;
+    for (const DiscoSegment& segment : segments) {
+        if (static_cast<size_t>(segment.offset) + segment.length > DISCO_MAX_PIXELS ||
+                static_cast<size_t>(segment.start) + segment.length > DISCO_MAX_PIXELS)
+            throw std::invalid_argument("segment reaches past " + std::to_string(DISCO_MAX_PIXELS) + " pixels");
+        if (segment.length > 0)
+            sorted.push_back(&segment);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const DiscoSegment* a, const DiscoSegment* b){ return a->offset < b->offset; });
+    for (size_t i = 1; i < sorted.size(); i++) {
+        if (sorted[i - 1]->offset + sorted[i - 1]->length > sorted[i]->offset)
+            throw std::invalid_argument("segments overlap at physical pixel " + std::to_string(sorted[i]->offset));
+    }
+
+    size_t count = sorted.empty() ? 0 : sorted.back()->offset + sorted.back()->length;
+    std::vector<uint32_t> gather(count, DISCO_UNLIT);
+    for (const DiscoSegment& segment : segments) {
+        for (uint32_t i = 0; i < segment.length; i++)
+            gather[segment.offset + i] = segment.start + (segment.reverse ? segment.length - 1 - i : i);
+    }
+    return gather;
+}
+
+void DiscoRemap::pack(uint8_t* out, const uint8_t* rgba, size_t length, size_t start, size_t end) const {
+    size_t count = this->size(length);
+    const uint32_t* gather = this->gather.empty() ? nullptr : this->gather.data();
+    for (size_t i = start; i < end; i++) {
+        size_t physical = this->reverse ? count - 1 - i : i;
+        size_t logical = gather != nullptr ? gather[physical] : physical;
+        // Pixels are copied as whole words, pixels past the frame stay dark
+        uint32_t pixel = 0;
+        if (logical < length)
+            memcpy(&pixel, rgba + logical * 4, 4);
+        memcpy(out + (i - start) * 4, &pixel, 4);
+    }
 }
 
 std::string conn_to_string(DiscoConnectionStatus status) {
@@ -54,27 +135,24 @@ std::string conn_to_string(DiscoConnectionStatus status) {
     return conn_to_string[status];
 }
 
-size_t write_packet(const std::vector<vec4>& pixels, char buffer[4096]) {
+// Packs physical pixels start to end of a frame of length logical pixels, remapping them on the way if remap is given
+size_t write_packet(const uint8_t* rgba, size_t length, const DiscoRemap* remap, size_t start, size_t end, char buffer[4096]) {
     // Fill packet information
     DiscoPacket packet;
-    packet.start = 0; // TODO: start, end, n_frames should be calculated dynamically from pixel length
-    packet.end = 150;
+    packet.start = start;
+    packet.end = end;
     packet.n_frames = 1;
-    // std::copy(pixels.begin(), pixels.end(), packet.data);
     size_t packet_len = (packet.end - packet.start) * packet.n_frames * 4 + 16;
 
-    if (packet_len > PACKET_MAX) {
+    if (packet_len > PACKET_MAX || (end - start) * 4 > sizeof(packet.data)) {
         fprintf(stderr, "Packet data to large %lld, buffer overflow\n", packet_len);
         return -1;
     }
 
-    for (size_t i = 0; i < pixels.size(); i++) {
-        const vec4 pixel = pixels[i];
-        packet.data[i * 4 + 0] = pixel.x * 255;
-        packet.data[i * 4 + 1] = pixel.y * 255;
-        packet.data[i * 4 + 2] = pixel.z * 255;
-        packet.data[i * 4 + 3] = pixel.w * 255;
-    }
+    if (remap != nullptr)
+        remap->pack(reinterpret_cast<uint8_t*>(packet.data), rgba, length, start, end);
+    else
+        memcpy(packet.data, rgba + start * 4, (end - start) * 4);
 
     memcpy(buffer, "LEDA", 4); // Set packet type
     memcpy(buffer + 4, &packet, packet_len - 4);
@@ -82,9 +160,7 @@ size_t write_packet(const std::vector<vec4>& pixels, char buffer[4096]) {
     return packet_len;
 }
 
-sockaddr_in get_addr(const std::unique_ptr<DiscoConfigManager>& manager, std::string device_name) {
-    DiscoConfig config = manager->get_config(device_name);
-    
+sockaddr_in get_addr(const DiscoConfig& config) {
     sockaddr_in addr;
     addr.sin_family = AF_INET;
     addr.sin_port = htons(PORT);
@@ -93,6 +169,10 @@ sockaddr_in get_addr(const std::unique_ptr<DiscoConfigManager>& manager, std::st
     return addr;
 }
 
+sockaddr_in get_addr(const std::unique_ptr<DiscoConfigManager>& manager, std::string device_name) {
+    return get_addr(manager->get_config(device_name));
+}
+
 void print_error(const char* error_msg) {
 #ifdef _WIN32
     fprintf(stderr, "%s %d\n", error_msg, WSAGetLastError());
@@ -289,10 +369,15 @@ std::shared_ptr<httpserver::http_response> ConfigPostResource::render_POST(const
     std::string_view json_body = req.get_content();
     // fprintf(stderr, "GOT BODY: %s\n ==END== \n", json_body.data());
 
-    json data = json::parse(json_body);
-    // fprintf(stderr, "GOT DATA: %s\n ==END== \n", data.dump(2).c_str());
-
-    auto config = data.get<DiscoConfig>();
+    DiscoConfig config;
+    try {
+        json data = json::parse(json_body);
+        // fprintf(stderr, "GOT DATA: %s\n ==END== \n", data.dump(2).c_str());
+        config = data.get<DiscoConfig>();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Rejected config: %s\n", e.what());
+        return std::shared_ptr<httpserver::http_response>(new httpserver::string_response(e.what(), httpserver::http::http_utils::http_bad_request));
+    }
     this->manager->set_config(config.controllerID, config);
 
     fprintf(stderr, "Updated config for %s\n", config.controllerID.c_str());
@@ -406,19 +491,36 @@ std::vector<std::string> UDPDisco::get_connection_names() const
 
 int UDPDisco::write(const std::string &id, const std::vector<vec4> &pixels)
 {
-    sockaddr_in server_addr = get_addr(this->manager, id);
+    // Quantize the whole frame in one vectorized pass, then packets are straight copies
+    thread_local std::vector<uint8_t> rgba;
+    rgba.resize(pixels.size() * 4);
+    get_kernels().quantize(rgba.data(), &pixels.data()->x, rgba.size());
+    return this->write(id, rgba.data(), pixels.size());
+}
 
-    // Write packet to socket
-    char send_buffer[PACKET_MAX];
-    int packet_len = write_packet(pixels, send_buffer);
-    if (packet_len < 0) {
-        return 1;
-    }
+int UDPDisco::write(const std::string &id, const uint8_t* rgba, size_t length)
+{
+    DiscoConfig config = this->manager->get_config(id);
+    sockaddr_in server_addr = get_addr(config);
+    size_t physical_length = config.remap != nullptr ? config.remap->size(length) : length;
+
+    // Split the pixels across as many packets as needed
+    const size_t pixels_per_packet = sizeof(DiscoPacket::data) / 4;
+    for (size_t start = 0; start < physical_length; start += pixels_per_packet) {
+        size_t end = std::min(start + pixels_per_packet, physical_length);
+
+        // Write packet to socket
+        char send_buffer[PACKET_MAX];
+        int packet_len = write_packet(rgba, length, config.remap.get(), start, end, send_buffer);
+        if (packet_len < 0) {
+            return 1;
+        }
 
-    int send_result = sendto(this->disco_socket, send_buffer, packet_len, 0, (sockaddr*) &server_addr, (int) sizeof(server_addr));
-    if (send_result < 0) {
-        print_error("Sending got an error");
-        return 1;
+        int send_result = sendto(this->disco_socket, send_buffer, packet_len, 0, (sockaddr*) &server_addr, (int) sizeof(server_addr));
+        if (send_result < 0) {
+            print_error("Sending got an error");
+            return 1;
+        }
     }
 
     return 0;
@@ -617,11 +719,16 @@ std::vector<std::string> mDNSRecordManager::get_configs_to(DiscoConfigManager& m
         auto& record = record_pair.second;
         if (record->host_name != "" && record->text.count("version") > 0) {
             fprintf(stderr, "Adding record %s\n", record->host_name.c_str());
+            // Keep the wiring of a device that was already configured, it is not advertised
+            std::shared_ptr<const DiscoRemap> remap;
+            if (manager.has_config(record->host_name))
+                remap = manager.get_config(record->host_name).remap;
             manager.set_config(record->host_name, {
                 record->host_name,
                 record->text.count("device") > 0 ? record->text["device"] : "unknown",
                 stoi(record->text["version"]),
-                this->ip4_table[record->host_name]
+                this->ip4_table[record->host_name],
+                remap
             }); // TODO: provide more info to config
             names.push_back(record->host_name);
         }
@@ -3,6 +3,7 @@
 
 #include <cinttypes>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 #include <httpserver.hpp>
@@ -27,11 +28,41 @@ struct DiscoPacket {
     char data[4000];
 };
 
+#define DISCO_UNLIT UINT32_MAX
+#define DISCO_MAX_PIXELS 65536 // Most physical pixels a remap can address, well above what one device drives
+
+// A run of logical pixels wired to a device, physical pixels outside every segment are left dark
+struct DiscoSegment {
+    uint32_t start = 0;  // First logical pixel of the run
+    uint32_t length = 0;
+    uint32_t offset = 0; // Physical pixel the run starts at
+    bool reverse = false;
+};
+
+// Where each physical pixel of a device takes its color from, for reversed strips, skipped pixels and
+// controllers driving several strips. Applied while pixels are packed, so remapping costs no extra pass.
+class DiscoRemap {
+    private:
+        std::vector<uint32_t> gather; // Logical pixel of each physical pixel or DISCO_UNLIT, empty for the identity
+        bool reverse; // Physical pixels are gathered from the end, after the gather table
+    public:
+        DiscoRemap(std::vector<uint32_t> gather, bool reverse=false) : gather(std::move(gather)), reverse(reverse) { }
+        // Throws std::invalid_argument if segments overlap or reach past DISCO_MAX_PIXELS
+        static std::vector<uint32_t> from_segments(const std::vector<DiscoSegment>& segments);
+        const std::vector<uint32_t>& get_gather() const { return this->gather; }
+        bool is_reversed() const { return this->reverse; }
+        // Physical pixels of the device for a frame of length logical pixels
+        size_t size(size_t length) const { return this->gather.empty() ? length : this->gather.size(); }
+        // Writes the RGBA bytes of physical pixels start to end of a frame of length logical pixels
+        void pack(uint8_t* out, const uint8_t* rgba, size_t length, size_t start, size_t end) const;
+};
+
 struct DiscoConfig {
     std::string controllerID;
     std::string device;
     int discoVersion;
     std::string address;
+    std::shared_ptr<const DiscoRemap> remap; // nullptr sends logical pixels as they are
 };
 
 void to_json(json& j, const DiscoConfig& config);
@@ -93,15 +124,29 @@ class DiscoMaster {
         virtual std::vector<std::string> get_connection_names() const = 0;
         virtual DiscoConfigManager& get_manager() const = 0;
         virtual int write(const std::string& id, const std::vector<vec4>& pixels) = 0;
+        // Writes length pixels already quantized to RGBA bytes
+        virtual int write(const std::string& id, const uint8_t* rgba, size_t length) = 0;
 };
 
+// Shared by the send threads of every output and the command thread, so every access is locked
 class DictionaryConfigManager : public DiscoConfigManager {
     private:
         std::unordered_map<std::string, DiscoConfig> dictionary;
+        std::mutex lock;
     public:
-        DiscoConfig get_config(std::string id) { return this->dictionary[id]; }
-        DiscoConfig set_config(std::string id, DiscoConfig config) { this->dictionary[id] = config; return this->dictionary[id]; }
-        bool has_config(std::string id) { return this->dictionary.count(id) > 0; }
+        DiscoConfig get_config(std::string id) {
+            std::lock_guard<std::mutex> guard(this->lock);
+            return this->dictionary.count(id) > 0 ? this->dictionary.at(id) : DiscoConfig();
+        }
+        DiscoConfig set_config(std::string id, DiscoConfig config) {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->dictionary[id] = config;
+            return this->dictionary[id];
+        }
+        bool has_config(std::string id) {
+            std::lock_guard<std::mutex> guard(this->lock);
+            return this->dictionary.count(id) > 0;
+        }
 };
 
 class HTTPConfigManager;
@@ -153,6 +198,7 @@ class UDPDisco : public DiscoMaster {
         std::vector<std::string> get_connection_names() const;
         DiscoConfigManager& get_manager() const { return *this->manager; }
         int write(const std::string& id, const std::vector<vec4>& pixels);
+        int write(const std::string& id, const uint8_t* rgba, size_t length);
 };
 
 class DiscoDiscoverer {
@@ -7,7 +7,34 @@
 #include "effects.hpp"
 
 
-ColorEffect::ColorEffect(const std::vector<ChromaData>& args) {
+// Updates per second for a pattern crossing the whole strip once every period
+static float get_motion_rate(const ChromaState& state, float period) {
+    return state.pixel_length / period / LOD_PIXEL_STEP;
+}
+
+// Shortest period both periods divide, infinite if it is over BAKE_MAX_PERIOD
+static double get_common_period(double a, double b) {
+    if (a == 0 || b == 0)
+        return a + b;
+    if (!std::isfinite(a) || !std::isfinite(b))
+        return INFINITY;
+    if (a < b)
+        std::swap(a, b);
+    for (int k = 1; k * a <= BAKE_MAX_PERIOD; k++) {
+        double multiple = k * a;
+        double ratio = multiple / b;
+        if (std::abs(ratio - std::round(ratio)) < 1e-4)
+            return multiple;
+    }
+    return INFINITY;
+}
+
+// Period of an effect repeating every period seconds on its own, drawing a child
+static double get_period_with(double period, const ChromaEffect& child, const ChromaState& state) {
+    return get_common_period(std::abs(period), child.get_period(state));
+}
+
+ColorEffect::ColorEffect(const std::vector<ChromaData>& args) : ChromaEffect("rgb") {
     this->color.x = args[0].get_int() / 255.0;
     this->color.y = args[1].get_int() / 255.0;
     this->color.z = args[2].get_int() / 255.0;
@@ -17,6 +44,21 @@ ColorEffect::ColorEffect(const std::vector<ChromaData>& args) {
         this->color.w = 1;
 }
 
+void ColorEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.emit_fill(this->color, out);
+}
+
+void AlphaEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    ChromaEffect::draw_child(*this->effect, indices, out, n, state);
+    for (size_t i = 0; i < n; i++)
+        out[i] = out[i] * this->alpha;
+}
+
+void AlphaEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.compile_child(*this->effect, indices, out, state);
+    program.emit_scale(this->alpha, out);
+}
+
 RainbowEffect::RainbowEffect(const std::vector<ChromaData>& args) : ChromaEffect("rainbow") { }
 
 vec4 RainbowEffect::draw(float index, const ChromaState& state) const {
@@ -25,7 +67,23 @@ vec4 RainbowEffect::draw(float index, const ChromaState& state) const {
     return max(-abs(pixel - 1) + 1, 0);
 }
 
-SplitEffect::SplitEffect(const std::vector<ChromaData>& args) {
+void RainbowEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    for (size_t j = 0; j < n; j++) {
+        float i = indices[j] * 3;
+        vec4 pixel = vec4(std::fmod(i + 1, 3), i, std::fmod(i - 1, 3), 1);
+        out[j] = max(-abs(pixel - 1) + 1, 0);
+    }
+}
+
+void RainbowEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    ChromaOp op;
+    op.code = OP_RAINBOW;
+    op.dst = out;
+    op.src = indices;
+    program.emit(op);
+}
+
+SplitEffect::SplitEffect(const std::vector<ChromaData>& args) : ChromaEffect("split") {
     for (auto& data : args[0].get_list()) {
         this->effects.push_back(data.get_effect());
     }
@@ -40,26 +98,209 @@ vec4 SplitEffect::draw(float index, const ChromaState& state) const {
     return this->effects[i]->draw(fmod(index, 1), state);
 }
 
-GradientEffect::GradientEffect(const std::vector<ChromaData>& args) {
+void SplitEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    int sections[CHROMA_SPAN_MAX];
+    float local[CHROMA_SPAN_MAX];
+    float gathered[CHROMA_SPAN_MAX];
+    size_t positions[CHROMA_SPAN_MAX];
+    vec4 colors[CHROMA_SPAN_MAX];
+
+    for (size_t offset = 0; offset < n; offset += CHROMA_SPAN_MAX) {
+        size_t len = std::min(n - offset, (size_t) CHROMA_SPAN_MAX);
+        for (size_t j = 0; j < len; j++) {
+            float index = indices[offset + j];
+            if (index != 1)
+                index = index * this->effects.size();
+            else
+                index = this->effects.size() - 1;
+            sections[j] = floor(index);
+            local[j] = fmod(index, 1);
+        }
+
+        // Gather the pixels of each section so every child draws one span
+        for (size_t k = 0; k < this->effects.size(); k++) {
+            size_t count = 0;
+            for (size_t j = 0; j < len; j++) {
+                if (sections[j] == (int) k) {
+                    gathered[count] = local[j];
+                    positions[count] = j;
+                    count++;
+                }
+            }
+            if (count == 0)
+                continue;
+            ChromaEffect::draw_child(*this->effects[k], gathered, colors, count, state);
+            for (size_t j = 0; j < count; j++)
+                out[offset + positions[j]] = colors[j];
+        }
+    }
+}
+
+ChromaStability SplitEffect::get_stability(const ChromaState& state) const {
+    ChromaStability stability = ChromaStability::constant();
+    for (auto& effect : this->effects)
+        stability = stability.combine(effect->get_stability(state));
+    return stability;
+}
+
+std::vector<const ChromaEffect*> SplitEffect::get_children() const {
+    std::vector<const ChromaEffect*> children;
+    for (auto& effect : this->effects)
+        children.push_back(effect.get());
+    return children;
+}
+
+double SplitEffect::get_period(const ChromaState& state) const {
+    double period = 0;
+    for (auto& effect : this->effects)
+        period = get_common_period(period, effect->get_period(state));
+    return period;
+}
+
+float SplitEffect::get_update_rate(const ChromaState& state) const {
+    float rate = 0;
+    for (auto& effect : this->effects)
+        rate = std::max(rate, effect->get_update_rate(state));
+    return rate;
+}
+
+void SplitEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    ChromaOp split;
+    split.code = OP_SPLIT;
+    split.src = indices;
+    split.dst = program.add_indices();
+    split.aux = program.add_indices();
+    split.count = this->effects.size();
+    program.emit(split);
+
+    // Each child runs on just its own pixels, like draw_span gathers them
+    for (size_t k = 0; k < this->effects.size(); k++) {
+        ChromaOp gather;
+        gather.code = OP_GATHER;
+        gather.src = split.dst;
+        gather.aux = split.aux;
+        gather.dst = program.add_indices();
+        gather.positions = program.add_indices();
+        gather.a = k;
+        program.begin_gather();
+        size_t gather_position = program.emit(gather);
+
+        uint16_t colors = program.add_colors();
+        program.compile_child(*this->effects[k], gather.dst, colors, state);
+
+        ChromaOp scatter;
+        scatter.code = OP_SCATTER;
+        scatter.src = colors;
+        scatter.dst = out;
+        scatter.positions = gather.positions;
+        program.at(gather_position).jump = program.emit(scatter);
+        program.end_gather();
+    }
+}
+
+GradientEffect::GradientEffect(const std::vector<ChromaData>& args) : ChromaEffect("gradient") {
     for (auto& data : args[0].get_list()) {
         this->effects.push_back(data.get_effect());
     }
 }
 
+void GradientEffect::tick(const ChromaState& state) {
+    for (auto& effect : this->effects)
+        ChromaEffect::tick_child(*effect, state);
+
+    // Children are always sampled at index 0 (or 1 for the end), so draw them once per frame
+    this->colors.resize(this->effects.size());
+    for (size_t k = 0; k < this->effects.size(); k++)
+        this->colors[k] = this->effects[k]->draw(0, state);
+    this->end = this->effects[this->effects.size() - 1]->draw(1, state);
+}
+
 vec4 GradientEffect::draw(float index, const ChromaState& state) const {
     if (this->effects.size() == 1)
         return this->effects[0]->draw(index, state); // TODO: add verifier for at least two args?
     
+    // Drawn before the first tick, the children are drawn directly
+    bool ticked = this->colors.size() == this->effects.size();
     if (index == 1)
-        return this->effects[this->effects.size() - 1]->draw(1, state);
+        return ticked ? this->end : this->effects[this->effects.size() - 1]->draw(1, state);
 
     index = index * (this->effects.size() - 1);
     int i = floor(index);
     float lerp = index - i;
+    if (!ticked)
+        return this->effects[i]->draw(0, state) * (1 - lerp) + this->effects[i + 1]->draw(0, state) * lerp;
+    return this->colors[i] * (1 - lerp) + this->colors[i + 1] * lerp;
+}
+
+void GradientEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    if (this->effects.size() == 1) {
+        ChromaEffect::draw_child(*this->effects[0], indices, out, n, state);
+        return;
+    }
+    if (this->colors.size() != this->effects.size()) {
+        ChromaEffect::draw_span(indices, out, n, state); // Not ticked yet, drawn pixel by pixel
+        return;
+    }
+
+    for (size_t j = 0; j < n; j++) {
+        float index = indices[j];
+        if (index == 1) {
+            out[j] = this->end;
+            continue;
+        }
+        index = index * (this->effects.size() - 1);
+        int i = floor(index);
+        float lerp = index - i;
+        out[j] = this->colors[i] * (1 - lerp) + this->colors[i + 1] * lerp;
+    }
+}
+
+std::vector<const ChromaEffect*> GradientEffect::get_children() const {
+    std::vector<const ChromaEffect*> children;
+    for (auto& effect : this->effects)
+        children.push_back(effect.get());
+    return children;
+}
+
+ChromaStability GradientEffect::get_stability(const ChromaState& state) const {
+    ChromaStability stability = ChromaStability::constant();
+    for (auto& effect : this->effects)
+        stability = stability.combine(effect->get_stability(state));
+    return stability;
+}
 
-    vec4 a = this->effects[i]->draw(0, state);
-    vec4 b = this->effects[i + 1]->draw(0, state);
-    return a * (1 - lerp) + b * lerp; 
+double GradientEffect::get_period(const ChromaState& state) const {
+    double period = 0;
+    for (auto& effect : this->effects)
+        period = get_common_period(period, effect->get_period(state));
+    return period;
+}
+
+float GradientEffect::get_update_rate(const ChromaState& state) const {
+    float rate = 0;
+    for (auto& effect : this->effects)
+        rate = std::max(rate, effect->get_update_rate(state));
+    return rate;
+}
+
+void GradientEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    if (this->effects.size() == 1) {
+        program.compile_child(*this->effects[0], indices, out, state);
+        return;
+    }
+    if (this->colors.size() != this->effects.size()) {
+        program.emit_call(this, indices, out); // Not ticked yet, there are no colors to hoist
+        return;
+    }
+
+    ChromaOp op;
+    op.code = OP_GRADIENT;
+    op.dst = out;
+    op.src = indices;
+    op.count = this->colors.size();
+    op.constant = program.add_constants(this->colors);
+    op.color = this->end;
+    program.emit(op);
 }
 
 SlideEffect::SlideEffect(const std::vector<ChromaData>& args) : ChromaEffect("slide") {
@@ -70,7 +311,7 @@ SlideEffect::SlideEffect(const std::vector<ChromaData>& args) : ChromaEffect("sl
 
 void SlideEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
 }
 
 vec4 SlideEffect::draw(float index, const ChromaState& state) const {
@@ -79,7 +320,36 @@ vec4 SlideEffect::draw(float index, const ChromaState& state) const {
     return this->effect->draw(index, state);
 }
 
-WipeEffect::WipeEffect(const std::vector<ChromaData>& args) : ChromaEffect("slide") {
+void SlideEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    float offset = fmod(state.get_time_diff(start) / this->time, 1);
+    float shifted[CHROMA_SPAN_MAX];
+    for (size_t k = 0; k < n; k += CHROMA_SPAN_MAX) {
+        size_t len = std::min(n - k, (size_t) CHROMA_SPAN_MAX);
+        for (size_t j = 0; j < len; j++)
+            shifted[j] = fmod(1 + indices[k + j] - offset, 1);
+        ChromaEffect::draw_child(*this->effect, shifted, out + k, len, state);
+    }
+}
+
+float SlideEffect::get_update_rate(const ChromaState& state) const {
+    return std::max(get_motion_rate(state, this->time), this->effect->get_update_rate(state));
+}
+
+double SlideEffect::get_period(const ChromaState& state) const {
+    return get_period_with(this->time, *this->effect, state);
+}
+
+void SlideEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    ChromaOp op;
+    op.code = OP_SLIDE;
+    op.src = indices;
+    op.dst = program.add_indices();
+    op.a = fmod(state.get_time_diff(start) / this->time, 1);
+    program.emit(op);
+    program.compile_child(*this->effect, op.dst, out, state);
+}
+
+WipeEffect::WipeEffect(const std::vector<ChromaData>& args) : ChromaEffect("wipe") {
     this->effect = args[0].get_effect();
     this->time = args[1].get_float();
     this->start = -1;
@@ -87,7 +357,8 @@ WipeEffect::WipeEffect(const std::vector<ChromaData>& args) : ChromaEffect("slid
 
 void WipeEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
+    this->color = this->draw(0, state);
 }
 
 vec4 WipeEffect::draw(float index, const ChromaState& state) const {
@@ -95,7 +366,23 @@ vec4 WipeEffect::draw(float index, const ChromaState& state) const {
     return this->effect->draw(offset, state);
 }
 
-BlinkEffect::BlinkEffect(const std::vector<ChromaData> &args)
+void WipeEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    std::fill(out, out + n, this->color);
+}
+
+float WipeEffect::get_update_rate(const ChromaState& state) const {
+    return std::max(get_motion_rate(state, this->time), this->effect->get_update_rate(state));
+}
+
+double WipeEffect::get_period(const ChromaState& state) const {
+    return get_period_with(this->time, *this->effect, state);
+}
+
+void WipeEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.emit_fill(this->color, out);
+}
+
+BlinkEffect::BlinkEffect(const std::vector<ChromaData> &args) : ChromaEffect("blink")
 {
     this->effect = args[0].get_effect();
     this->time = args[1].get_float();
@@ -104,10 +391,11 @@ BlinkEffect::BlinkEffect(const std::vector<ChromaData> &args)
 
 void BlinkEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
 
     int i = floor(state.get_time_diff(this->start) / this->time);
     this->on = i % 2 == 0;
+    this->next_toggle = this->start + (i + 1) * this->time;
 }
 
 vec4 BlinkEffect::draw(float index, const ChromaState& state) const {
@@ -118,7 +406,33 @@ vec4 BlinkEffect::draw(float index, const ChromaState& state) const {
         return vec4(0, 0, 0, 0); // TODO: decide to use premultiplied or straight alpha
 }
 
-BlinkFadeEffect::BlinkFadeEffect(const std::vector<ChromaData> &args)
+void BlinkEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    if (this->on)
+        ChromaEffect::draw_child(*this->effect, indices, out, n, state);
+    else
+        std::fill(out, out + n, vec4(0, 0, 0, 0));
+}
+
+ChromaStability BlinkEffect::get_stability(const ChromaState& state) const {
+    ChromaStability toggle = ChromaStability::piecewise(this->next_toggle);
+    if (!this->on)
+        return toggle;
+    return toggle.combine(this->effect->get_stability(state));
+}
+
+// On for time and off for time
+double BlinkEffect::get_period(const ChromaState& state) const {
+    return get_period_with(2 * this->time, *this->effect, state);
+}
+
+void BlinkEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    if (this->on)
+        program.compile_child(*this->effect, indices, out, state);
+    else
+        program.emit_fill(vec4(0, 0, 0, 0), out);
+}
+
+BlinkFadeEffect::BlinkFadeEffect(const std::vector<ChromaData> &args) : ChromaEffect("blinkfade")
 {
     this->effect = args[0].get_effect();
     this->time = args[1].get_float();
@@ -127,7 +441,7 @@ BlinkFadeEffect::BlinkFadeEffect(const std::vector<ChromaData> &args)
 
 void BlinkFadeEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
 
     float t = fmod(state.get_time_diff(this->start) / this->time, 2);
     this->transition = 1.0 - abs(t - 1.0);
@@ -138,16 +452,32 @@ vec4 BlinkFadeEffect::draw(float index, const ChromaState& state) const {
     return color * this->transition;
 }
 
-WormEffect::WormEffect(const std::vector<ChromaData> &args)
+void BlinkFadeEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    ChromaEffect::draw_child(*this->effect, indices, out, n, state);
+    for (size_t i = 0; i < n; i++)
+        out[i] = out[i] * this->transition;
+}
+
+double BlinkFadeEffect::get_period(const ChromaState& state) const {
+    return get_period_with(2 * this->time, *this->effect, state);
+}
+
+void BlinkFadeEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.compile_child(*this->effect, indices, out, state);
+    program.emit_scale(this->transition, out);
+}
+
+WormEffect::WormEffect(const std::vector<ChromaData> &args) : ChromaEffect("worm")
 {
     this->effect = args[0].get_effect();
     this->time = args[1].get_float();
     this->start = -1;
+    this->cutoff = 0;
 }
 
 void WormEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
 
     this->cutoff = state.get_time_diff(this->start) / this->time;
 }
@@ -159,16 +489,52 @@ vec4 WormEffect::draw(float index, const ChromaState& state) const {
         return vec4(0, 0, 0, 0);
 }
 
-FadeInEffect::FadeInEffect(const std::vector<ChromaData> &args)
+void WormEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    ChromaEffect::draw_child(*this->effect, indices, out, n, state);
+    for (size_t i = 0; i < n; i++) {
+        if (indices[i] > this->cutoff)
+            out[i] = vec4(0, 0, 0, 0);
+    }
+}
+
+ChromaStability WormEffect::get_stability(const ChromaState& state) const {
+    if (this->cutoff < 1)
+        return ChromaStability::varying();
+    return this->effect->get_stability(state);
+}
+
+float WormEffect::get_update_rate(const ChromaState& state) const {
+    return std::max(get_motion_rate(state, this->time), this->effect->get_update_rate(state));
+}
+
+// Grows once, then shows its child as is
+double WormEffect::get_period(const ChromaState& state) const {
+    if (this->cutoff < 1)
+        return INFINITY;
+    return this->effect->get_period(state);
+}
+
+void WormEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.compile_child(*this->effect, indices, out, state);
+    ChromaOp op;
+    op.code = OP_CUTOFF;
+    op.dst = out;
+    op.src = indices;
+    op.a = this->cutoff;
+    program.emit(op);
+}
+
+FadeInEffect::FadeInEffect(const std::vector<ChromaData> &args) : ChromaEffect("fadein")
 {
     this->effect = args[0].get_effect();
     this->time = args[1].get_float();
     this->start = -1;
+    this->transition = 0;
 }
 
 void FadeInEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
 
     float t = state.get_time_diff(this->start) / this->time;
     if (t > 1)
@@ -181,16 +547,47 @@ vec4 FadeInEffect::draw(float index, const ChromaState& state) const {
     return color * this->transition;
 }
 
-FadeOutEffect::FadeOutEffect(const std::vector<ChromaData> &args)
+void FadeInEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    ChromaEffect::draw_child(*this->effect, indices, out, n, state);
+    for (size_t i = 0; i < n; i++)
+        out[i] = out[i] * this->transition;
+}
+
+ChromaStability FadeInEffect::get_stability(const ChromaState& state) const {
+    if (this->transition < 1)
+        return ChromaStability::varying();
+    return this->effect->get_stability(state);
+}
+
+// Fades are linear in time, so interpolating them is exact until they finish
+float FadeInEffect::get_update_rate(const ChromaState& state) const {
+    if (this->transition < 1)
+        return std::max(LOD_LINEAR_RATE, this->effect->get_update_rate(state));
+    return this->effect->get_update_rate(state);
+}
+
+double FadeInEffect::get_period(const ChromaState& state) const {
+    if (this->transition < 1)
+        return INFINITY;
+    return this->effect->get_period(state);
+}
+
+void FadeInEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.compile_child(*this->effect, indices, out, state);
+    program.emit_scale(this->transition, out);
+}
+
+FadeOutEffect::FadeOutEffect(const std::vector<ChromaData> &args) : ChromaEffect("fadeout")
 {
     this->effect = args[0].get_effect();
     this->time = args[1].get_float();
     this->start = -1;
+    this->transition = 1;
 }
 
 void FadeOutEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
 
     float t = 1.0 - state.get_time_diff(this->start) / this->time;
     if (t < 0)
@@ -203,7 +600,36 @@ vec4 FadeOutEffect::draw(float index, const ChromaState& state) const {
     return color * this->transition;
 }
 
-WaveEffect::WaveEffect(const std::vector<ChromaData> &args)
+void FadeOutEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    ChromaEffect::draw_child(*this->effect, indices, out, n, state);
+    for (size_t i = 0; i < n; i++)
+        out[i] = out[i] * this->transition;
+}
+
+ChromaStability FadeOutEffect::get_stability(const ChromaState& state) const {
+    if (this->transition > 0)
+        return ChromaStability::varying();
+    return ChromaStability::constant();
+}
+
+float FadeOutEffect::get_update_rate(const ChromaState& state) const {
+    if (this->transition > 0)
+        return std::max(LOD_LINEAR_RATE, this->effect->get_update_rate(state));
+    return this->effect->get_update_rate(state);
+}
+
+double FadeOutEffect::get_period(const ChromaState& state) const {
+    if (this->transition > 0)
+        return INFINITY;
+    return 0;
+}
+
+void FadeOutEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.compile_child(*this->effect, indices, out, state);
+    program.emit_scale(this->transition, out);
+}
+
+WaveEffect::WaveEffect(const std::vector<ChromaData> &args) : ChromaEffect("wave")
 {
     this->effect = args[0].get_effect();
     this->period = args[1].get_float();
@@ -214,17 +640,56 @@ WaveEffect::WaveEffect(const std::vector<ChromaData> &args)
 
 void WaveEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
+}
+
+// Periods elapsed since the effect started, without the whole periods so the float phase stays precise
+static float get_cycle(const ChromaState& state, double start, float period) {
+    return fmod(state.get_time_diff(start) / period, 1);
 }
 
 vec4 WaveEffect::draw(float index, const ChromaState& state) const {
-    float t = state.get_time_diff(this->start);
-    float phase = (index * state.pixel_length / this->wavelength - t / this->period) * 2 * M_PI;
+    float cycle = get_cycle(state, this->start, this->period);
+    float phase = (index * state.pixel_length / this->wavelength - cycle) * 2 * M_PI;
     float val = (1 + sin(phase)) / 2;
     return this->effect->draw(val, state);
 }
 
-WheelEffect::WheelEffect(const std::vector<ChromaData> &args)
+void WaveEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    float cycle = get_cycle(state, this->start, this->period);
+    float values[CHROMA_SPAN_MAX];
+    for (size_t k = 0; k < n; k += CHROMA_SPAN_MAX) {
+        size_t len = std::min(n - k, (size_t) CHROMA_SPAN_MAX);
+        for (size_t j = 0; j < len; j++) {
+            float phase = (indices[k + j] * state.pixel_length / this->wavelength - cycle) * 2 * M_PI;
+            values[j] = (1 + sin(phase)) / 2;
+        }
+        ChromaEffect::draw_child(*this->effect, values, out + k, len, state);
+    }
+}
+
+float WaveEffect::get_update_rate(const ChromaState& state) const {
+    // The index into the child moves at up to pi per period, at the zero crossings of the sine
+    return std::max(get_motion_rate(state, this->period) * static_cast<float>(M_PI), this->effect->get_update_rate(state));
+}
+
+double WaveEffect::get_period(const ChromaState& state) const {
+    return get_period_with(this->period, *this->effect, state);
+}
+
+void WaveEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    ChromaOp op;
+    op.code = OP_WAVE;
+    op.src = indices;
+    op.dst = program.add_indices();
+    op.a = state.pixel_length;
+    op.b = this->wavelength;
+    op.c = get_cycle(state, this->start, this->period);
+    program.emit(op);
+    program.compile_child(*this->effect, op.dst, out, state);
+}
+
+WheelEffect::WheelEffect(const std::vector<ChromaData> &args) : ChromaEffect("wheel")
 {
     this->effect = args[0].get_effect();
     this->period = args[1].get_float();
@@ -234,12 +699,118 @@ WheelEffect::WheelEffect(const std::vector<ChromaData> &args)
 
 void WheelEffect::tick(const ChromaState& state) {
     if (start < 0) this->start = state.time;
-    this->effect->tick(state);
+    ChromaEffect::tick_child(*this->effect, state);
+    this->color = this->draw(0, state);
 }
 
 vec4 WheelEffect::draw(float index, const ChromaState& state) const {
-    float t = state.get_time_diff(this->start);
-    float phase = (t / this->period) * 2 * M_PI;
+    float phase = get_cycle(state, this->start, this->period) * 2 * M_PI;
     float val = (1 + sin(phase)) / 2;
     return this->effect->draw(val, state);
 }
+
+void WheelEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    std::fill(out, out + n, this->color);
+}
+
+float WheelEffect::get_update_rate(const ChromaState& state) const {
+    return std::max(get_motion_rate(state, this->period), this->effect->get_update_rate(state));
+}
+
+double WheelEffect::get_period(const ChromaState& state) const {
+    return get_period_with(this->period, *this->effect, state);
+}
+
+void WheelEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.emit_fill(this->color, out);
+}
+
+// Position of the pixel an index is drawn at, along a line when drawn outside an output
+static void get_position(float index, const ChromaState& state, float& x, float& y, float& z) {
+    if (state.layout == nullptr) {
+        x = index;
+        y = 0;
+        z = 0;
+        return;
+    }
+    size_t pixel = state.layout->get_pixel(index);
+    x = state.layout->get_x()[pixel];
+    y = state.layout->get_y()[pixel];
+    z = state.layout->get_z()[pixel];
+}
+
+// Size of the output's layout along an axis, a unit line when drawn outside an output
+static float get_extent(const ChromaState& state, int axis) {
+    if (state.layout == nullptr)
+        return axis == 0 ? 1 : 0;
+    return state.layout->get_extent(axis);
+}
+
+// Draws the child at the child index every layout index maps to, a span at a time
+template <class IndexFunction>
+static void draw_mapped(const ChromaEffect& effect, const float* indices, vec4* out, size_t n, const ChromaState& state, IndexFunction map) {
+    float mapped[CHROMA_SPAN_MAX];
+    for (size_t k = 0; k < n; k += CHROMA_SPAN_MAX) {
+        size_t len = std::min(n - k, (size_t) CHROMA_SPAN_MAX);
+        for (size_t j = 0; j < len; j++) {
+            float x, y, z;
+            get_position(indices[k + j], state, x, y, z);
+            mapped[j] = map(x, y, z);
+        }
+        ChromaEffect::draw_child(effect, mapped, out + k, len, state);
+    }
+}
+
+SweepEffect::SweepEffect(const std::vector<ChromaData>& args) : ChromaEffect("sweep") {
+    this->effect = args[0].get_effect();
+    this->angle = args[1].get_float() * M_PI / 180;
+    this->elevation = args.size() > 2 ? args[2].get_float() * M_PI / 180 : 0;
+}
+
+vec4 SweepEffect::draw(float index, const ChromaState& state) const {
+    vec4 color;
+    this->draw_span(&index, &color, 1, state);
+    return color;
+}
+
+void SweepEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    float dx = cos(this->elevation) * cos(this->angle);
+    float dy = cos(this->elevation) * sin(this->angle);
+    float dz = sin(this->elevation);
+    float width = get_extent(state, 0);
+    float height = get_extent(state, 1);
+    float depth = get_extent(state, 2);
+    // The projections of the bounding box corners span the layout
+    float low = std::min(0.0f, width * dx) + std::min(0.0f, height * dy) + std::min(0.0f, depth * dz);
+    float range = std::abs(width * dx) + std::abs(height * dy) + std::abs(depth * dz);
+    draw_mapped(*this->effect, indices, out, n, state, [=](float x, float y, float z){
+        return range > 0 ? std::clamp((x * dx + y * dy + z * dz - low) / range, 0.0f, 1.0f) : 0;
+    });
+}
+
+RadialEffect::RadialEffect(const std::vector<ChromaData>& args) : ChromaEffect("radial") {
+    this->effect = args[0].get_effect();
+    this->center_x = args.size() > 1 ? args[1].get_float() : 0.5f;
+    this->center_y = args.size() > 2 ? args[2].get_float() : 0.5f;
+    this->center_z = args.size() > 3 ? args[3].get_float() : 0.5f;
+}
+
+vec4 RadialEffect::draw(float index, const ChromaState& state) const {
+    vec4 color;
+    this->draw_span(&index, &color, 1, state);
+    return color;
+}
+
+void RadialEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const {
+    float width = get_extent(state, 0);
+    float height = get_extent(state, 1);
+    float depth = get_extent(state, 2);
+    float cx = this->center_x * width;
+    float cy = this->center_y * height;
+    float cz = this->center_z * depth;
+    // Farthest corner of the bounding box from the center, a flat layout has no depth so this stays a circle
+    float radius = std::hypot(std::max(cx, width - cx), std::max(cy, height - cy), std::max(cz, depth - cz));
+    draw_mapped(*this->effect, indices, out, n, state, [=](float x, float y, float z){
+        return radius > 0 ? std::min(std::hypot(x - cx, y - cy, z - cz) / radius, 1.0f) : 0;
+    });
+}
@@ -1,8 +1,13 @@
 #ifndef CHROMA_EFFECTS_H
 #define CHROMA_EFFECTS_H
 
+#include <algorithm>
+
 #include "chroma.hpp"
+#include "program.hpp"
 
+#define LOD_PIXEL_STEP 0.5f // Pixels a pattern may move between interpolated updates
+#define LOD_LINEAR_RATE 10.0f // Updates per second for changes that are linear in time
 
 class ColorEffect : public ChromaEffect {
     private:
@@ -10,6 +15,11 @@ class ColorEffect : public ChromaEffect {
     public:
         ColorEffect(const std::vector<ChromaData>& args);
         vec4 draw(float index, const ChromaState& state) const { return color; }
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const { std::fill(out, out + n, this->color); }
+        ChromaStability get_stability(const ChromaState& state) const { return ChromaStability::constant(); }
+        float get_update_rate(const ChromaState& state) const { return 0; }
+        double get_period(const ChromaState& state) const { return 0; }
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class AlphaEffect : public ChromaEffect {
@@ -17,15 +27,26 @@ class AlphaEffect : public ChromaEffect {
         std::shared_ptr<ChromaEffect> effect;
         float alpha;
     public:
-        AlphaEffect(const std::vector<ChromaData>& args) : effect(args[0].get_effect()), alpha(args[1].get_float()) {}
-        void tick(const ChromaState& state) { this->effect->tick(state); }
+        AlphaEffect(const std::vector<ChromaData>& args) : ChromaEffect("alpha"), effect(args[0].get_effect()), alpha(args[1].get_float()) {}
+        void tick(const ChromaState& state) { ChromaEffect::tick_child(*this->effect, state); }
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const { return this->effect->draw(index, state) * alpha; }
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const { return this->effect->get_stability(state); }
+        float get_update_rate(const ChromaState& state) const { return this->effect->get_update_rate(state); }
+        double get_period(const ChromaState& state) const { return this->effect->get_period(state); }
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class RainbowEffect : public ChromaEffect {
     public:
         RainbowEffect(const std::vector<ChromaData>& args);
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const { return ChromaStability::constant(); }
+        float get_update_rate(const ChromaState& state) const { return 0; }
+        double get_period(const ChromaState& state) const { return 0; }
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class SplitEffect : public ChromaEffect {
@@ -33,39 +54,64 @@ class SplitEffect : public ChromaEffect {
         std::vector<std::shared_ptr<ChromaEffect>> effects;
     public:
         SplitEffect(const std::vector<ChromaData>& args);
-        void tick(const ChromaState& state) { for (auto& effect : this->effects) effect->tick(state); }
+        void tick(const ChromaState& state) { for (auto& effect : this->effects) ChromaEffect::tick_child(*effect, state); }
+        std::vector<const ChromaEffect*> get_children() const;
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class GradientEffect : public ChromaEffect {
     private:
         std::vector<std::shared_ptr<ChromaEffect>> effects;
+        std::vector<vec4> colors; // Children drawn at index 0, once per tick
+        vec4 end;                 // Last child drawn at index 1
     public:
         GradientEffect(const std::vector<ChromaData>& args);
-        void tick(const ChromaState& state) { for (auto& effect : this->effects) effect->tick(state); }
+        void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const;
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class SlideEffect : public ChromaEffect {
     private:
         std::shared_ptr<ChromaEffect> effect;
         float time;
-        float start;
+        double start;
     public:
         SlideEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class WipeEffect : public ChromaEffect {
     private:
         std::shared_ptr<ChromaEffect> effect;
         float time;
-        float start;
+        double start;
+        vec4 color; // Every pixel is the same, drawn once per tick
     public:
         WipeEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 
@@ -73,60 +119,88 @@ class BlinkEffect : public ChromaEffect {
     private:
         std::shared_ptr<ChromaEffect> effect;
         float time;
-        float start;
+        double start;
+        double next_toggle;
         bool on;
     public:
         BlinkEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class BlinkFadeEffect : public ChromaEffect {
     private:
         std::shared_ptr<ChromaEffect> effect;
         float time;
-        float start;
+        double start;
         float transition;
     public:
         BlinkFadeEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class WormEffect : public ChromaEffect {
     private:
         std::shared_ptr<ChromaEffect> effect;
         float time;
-        float start;
+        double start;
         float cutoff;
     public:
         WormEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class FadeInEffect : public ChromaEffect {
     private:
         std::shared_ptr<ChromaEffect> effect;
         float time;
-        float start;
+        double start;
         float transition;
     public:
         FadeInEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class FadeOutEffect : public ChromaEffect {
     private:
         std::shared_ptr<ChromaEffect> effect;
         float time;
-        float start;
+        double start;
         float transition;
     public:
         FadeOutEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class WaveEffect : public ChromaEffect {
@@ -134,22 +208,68 @@ class WaveEffect : public ChromaEffect {
         std::shared_ptr<ChromaEffect> effect;
         float period;
         float wavelength;
-        float start;
+        double start;
     public:
         WaveEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
 };
 
 class WheelEffect : public ChromaEffect {
     private:
         std::shared_ptr<ChromaEffect> effect;
         float period;
-        float start;
+        double start;
+        vec4 color; // Every pixel is the same, drawn once per tick
     public:
         WheelEffect(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
+        vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        float get_update_rate(const ChromaState& state) const;
+        double get_period(const ChromaState& state) const;
+        void compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const;
+};
+
+// Draws the child along a direction across the output's layout, so a strip effect sweeps over a matrix
+class SweepEffect : public ChromaEffect {
+    private:
+        std::shared_ptr<ChromaEffect> effect;
+        float angle;     // Radians around z, 0 along x
+        float elevation; // Radians up from the xy plane towards z
+    public:
+        SweepEffect(const std::vector<ChromaData>& args);
+        void tick(const ChromaState& state) { ChromaEffect::tick_child(*this->effect, state); }
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
+        vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const { return this->effect->get_stability(state); }
+        float get_update_rate(const ChromaState& state) const { return this->effect->get_update_rate(state); }
+        double get_period(const ChromaState& state) const { return this->effect->get_period(state); }
+};
+
+// Draws the child outwards from a point of the output's layout, in circles on a flat layout and spheres on a 3D one
+class RadialEffect : public ChromaEffect {
+    private:
+        std::shared_ptr<ChromaEffect> effect;
+        float center_x;
+        float center_y;
+        float center_z;
+    public:
+        RadialEffect(const std::vector<ChromaData>& args);
+        void tick(const ChromaState& state) { ChromaEffect::tick_child(*this->effect, state); }
+        std::vector<const ChromaEffect*> get_children() const { return {this->effect.get()}; }
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+        ChromaStability get_stability(const ChromaState& state) const { return this->effect->get_stability(state); }
+        float get_update_rate(const ChromaState& state) const { return this->effect->get_update_rate(state); }
+        double get_period(const ChromaState& state) const { return this->effect->get_period(state); }
 };
 
 #endif
\ No newline at end of file
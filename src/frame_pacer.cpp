@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+#include "frame_pacer.hpp"
+
+std::string FramePacerStats::to_string() const {
+    return "frames: " + std::to_string(this->frames) +
+        ", overruns: " + std::to_string(this->overruns) +
+        ", skipped: " + std::to_string(this->skipped) +
+        ", jitter (us) last: " + std::to_string(this->last_jitter_us) +
+        " mean: " + std::to_string(this->mean_jitter_us) +
+        " max: " + std::to_string(this->max_jitter_us);
+}
+
+void FrameTimeHistory::record(double time_us) {
+    this->samples[this->next] = time_us;
+    this->next = (this->next + 1) % this->samples.size();
+    this->count = std::min(this->count + 1, this->samples.size());
+}
+
+double FrameTimeHistory::percentile(double p) const {
+    if (this->count == 0)
+        return 0;
+    std::vector<double> sorted(this->samples.begin(), this->samples.begin() + this->count);
+    size_t rank = std::min(static_cast<size_t>(p / 100 * this->count), this->count - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+std::string FrameTimeHistory::to_string() const {
+    return "p50: " + std::to_string(this->percentile(50)) +
+        " p90: " + std::to_string(this->percentile(90)) +
+        " p99: " + std::to_string(this->percentile(99)) +
+        " max: " + std::to_string(this->percentile(100));
+}
+
+int64_t get_monotonic_ns() {
+#ifdef _WIN32
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+void sleep_until_ns(int64_t deadline_ns) {
+#ifdef _WIN32
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadline_ns)));
+#else
+    timespec deadline;
+    deadline.tv_sec = deadline_ns / 1000000000;
+    deadline.tv_nsec = deadline_ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) { }
+#endif
+}
+
+FramePacer::FramePacer(int fps, MissedFramePolicy policy) : period_ns(1000000000 / std::max(fps, 1)), policy(policy) { }
+
+void FramePacer::start() {
+    this->deadline_ns = get_monotonic_ns() + this->period_ns;
+}
+
+void FramePacer::wait() {
+    int64_t now = get_monotonic_ns();
+    this->stats.frames++;
+
+    if (now > this->deadline_ns) {
+        this->stats.overruns++;
+        this->stats.last_jitter_us = 0;
+    }
+    else {
+        sleep_until_ns(this->deadline_ns);
+        now = get_monotonic_ns();
+        double jitter = (now - this->deadline_ns) / 1e3;
+        this->stats.last_jitter_us = jitter;
+        this->stats.max_jitter_us = std::max(this->stats.max_jitter_us, jitter);
+        this->stats.sampled++;
+        this->stats.mean_jitter_us += (jitter - this->stats.mean_jitter_us) / this->stats.sampled;
+    }
+
+    this->deadline_ns += this->period_ns;
+    if (now > this->deadline_ns && this->policy == SKIP_MISSED) {
+        int64_t missed = (now - this->deadline_ns) / this->period_ns + 1;
+        this->deadline_ns += missed * this->period_ns;
+        this->stats.skipped += missed;
+    }
+}
+
+int apply_memory_lock(bool lock) {
+#ifdef _WIN32
+    if (lock) {
+        fprintf(stderr, "Locking memory is not supported on this platform\n");
+        return -1;
+    }
+#else
+    if (lock && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        perror("mlockall failed");
+        return -1;
+    }
+    if (!lock && munlockall() != 0) {
+        perror("munlockall failed");
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+int apply_realtime(const RealtimeConfig& config, int cpu, std::thread::native_handle_type thread) {
+    int result = 0;
+#ifdef _WIN32
+    if (config.priority > 0 || cpu >= 0) {
+        fprintf(stderr, "Real-time scheduling is not supported on this platform\n");
+        result = -1;
+    }
+#else
+    sched_param param;
+    param.sched_priority = config.priority > 0 ? config.priority : 0;
+    int error = pthread_setschedparam(thread, config.priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+    if (error != 0) {
+        fprintf(stderr, "Setting %s failed with error %d\n", config.priority > 0 ? "SCHED_FIFO" : "SCHED_OTHER", error);
+        result = -1;
+    }
+
+#ifdef __linux__
+    // Threads start on the CPUs the process was started on, unpinning goes back to those.
+    // Read on the first call, before any thread is pinned.
+    static const cpu_set_t process_cpus = []() {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+            for (int i = 0; i < CPU_SETSIZE; i++)
+                CPU_SET(i, &set);
+        }
+        return set;
+    }();
+    cpu_set_t set = process_cpus;
+    if (cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+    }
+    error = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (error != 0) {
+        if (cpu >= 0)
+            fprintf(stderr, "Pinning thread to CPU %d failed with error %d\n", cpu, error);
+        else
+            fprintf(stderr, "Unpinning thread failed with error %d\n", error);
+        result = -1;
+    }
+#endif
+#endif
+    return result;
+}
+
+int apply_realtime(const RealtimeConfig& config, int cpu) {
+#ifdef _WIN32
+    return apply_realtime(config, cpu, GetCurrentThread());
+#else
+    return apply_realtime(config, cpu, pthread_self());
+#endif
+}
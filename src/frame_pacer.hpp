@@ -0,0 +1,74 @@
+#ifndef CHROMA_FRAME_PACER_H
+#define CHROMA_FRAME_PACER_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum MissedFramePolicy {
+    SKIP_MISSED, // Drop the missed deadlines and realign to the next one
+    CATCH_UP     // Run the missed frames back to back until on schedule again
+};
+
+struct FramePacerStats {
+    uint64_t frames = 0;
+    uint64_t overruns = 0; // Frames that finished after their deadline
+    uint64_t skipped = 0;  // Deadlines dropped under SKIP_MISSED
+    uint64_t sampled = 0;  // Frames that slept until their deadline, the jitter is measured on these only
+    double last_jitter_us = 0;
+    double mean_jitter_us = 0;
+    double max_jitter_us = 0;
+    std::string to_string() const;
+};
+
+// Rolling window of the most recent frame times for percentile reporting
+class FrameTimeHistory {
+    private:
+        std::vector<double> samples;
+        size_t next = 0;
+        size_t count = 0;
+    public:
+        FrameTimeHistory(size_t capacity = 1024) : samples(capacity) { }
+        void record(double time_us);
+        void clear() { this->next = 0; this->count = 0; }
+        size_t size() const { return this->count; }
+        double percentile(double p) const;
+        std::string to_string() const;
+};
+
+struct RealtimeConfig {
+    int priority = 0;         // SCHED_FIFO priority, 0 for the default scheduler
+    int render_cpu = -1;      // CPU to pin the render thread to, -1 for the CPUs the process started on
+    int send_cpu = -1;        // CPU to pin the send thread to when pipelined, -1 for the CPUs the process started on
+    int worker_cpu = -1;      // First of the consecutive CPUs to pin the render pool's workers to, -1 for the CPUs the process started on
+    bool lock_memory = false; // mlockall the process to avoid page faults mid-frame, munlockall when turned off
+};
+
+// Paces a loop on absolute CLOCK_MONOTONIC deadlines so the frame rate does not drift with load
+class FramePacer {
+    private:
+        int64_t period_ns;
+        int64_t deadline_ns = 0;
+        MissedFramePolicy policy;
+        FramePacerStats stats;
+    public:
+        FramePacer(int fps, MissedFramePolicy policy = SKIP_MISSED);
+        void start();
+        // Sleeps until the current frame's deadline and schedules the next one
+        void wait();
+        void set_policy(MissedFramePolicy policy) { this->policy = policy; }
+        MissedFramePolicy get_policy() const { return this->policy; }
+        const FramePacerStats& get_stats() const { return this->stats; }
+        void reset_stats() { this->stats = FramePacerStats(); }
+};
+
+int64_t get_monotonic_ns();
+// Applies the scheduling settings to the calling thread or to thread, pinned to cpu, undoing earlier ones that are now off.
+// Memory locking is process wide and left to apply_memory_lock. Returns non-zero if any of them failed.
+int apply_realtime(const RealtimeConfig& config, int cpu);
+int apply_realtime(const RealtimeConfig& config, int cpu, std::thread::native_handle_type thread);
+// mlockalls the process, or munlockalls it when lock is false. Returns non-zero if it failed.
+int apply_memory_lock(bool lock);
+
+#endif
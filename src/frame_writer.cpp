@@ -0,0 +1,64 @@
+#include "frame_writer.hpp"
+
+FrameFileFormat get_frame_file_format(const std::string& filename) {
+    const std::string extension = ".npy";
+    if (filename.size() >= extension.size() && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0)
+        return FRAME_FILE_NPY;
+    return FRAME_FILE_RAW;
+}
+
+int FrameWriter::write_npy_header() {
+    std::string header = "{'descr': '" + std::string(this->pixel_format == PIXEL_BYTE ? "|u1" : "<f4") +
+        "', 'fortran_order': False, 'shape': (" + std::to_string(this->num_frames) + ", " +
+        std::to_string(this->pixel_length) + ", 4), }";
+    // Magic, version and length take 10 bytes, pad so the data starts 64 byte aligned
+    size_t total = (10 + header.size() + 1 + 63) / 64 * 64;
+    header.append(total - 10 - header.size() - 1, ' ');
+    header += '\n';
+
+    unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+        static_cast<unsigned char>(header.size() & 0xff), static_cast<unsigned char>(header.size() >> 8)};
+    if (fwrite(preamble, 1, sizeof(preamble), this->file) != sizeof(preamble))
+        return 1;
+    if (fwrite(header.data(), 1, header.size(), this->file) != header.size())
+        return 1;
+    return 0;
+}
+
+int FrameWriter::open(const std::string& filename) {
+    this->close();
+    this->file = fopen(filename.c_str(), "wb");
+    if (this->file == nullptr) {
+        fprintf(stderr, "Could not open %s for writing\n", filename.c_str());
+        return 1;
+    }
+    if (this->format == FRAME_FILE_NPY && this->write_npy_header() != 0) {
+        fprintf(stderr, "Could not write the header of %s\n", filename.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int FrameWriter::write(const ChromaFrame& frame) {
+    if (this->file == nullptr || frame.format != this->pixel_format || frame.size() != this->pixel_length)
+        return 1;
+    if (this->format == FRAME_FILE_NPY && this->frames_written >= this->num_frames)
+        return 1;
+
+    size_t written;
+    if (frame.format == PIXEL_BYTE)
+        written = fwrite(frame.bytes.data(), 4, frame.size(), this->file);
+    else
+        written = fwrite(frame.pixels.data(), sizeof(vec4), frame.size(), this->file);
+    if (written != frame.size())
+        return 1;
+    this->frames_written++;
+    return 0;
+}
+
+void FrameWriter::close() {
+    if (this->file == nullptr)
+        return;
+    fclose(this->file);
+    this->file = nullptr;
+}
@@ -0,0 +1,40 @@
+#ifndef CHROMA_FRAME_WRITER_H
+#define CHROMA_FRAME_WRITER_H
+
+#include <cstdio>
+#include <string>
+
+#include "chroma.hpp"
+
+enum FrameFileFormat {
+    FRAME_FILE_RAW, // Frames back to back, float32 or uint8 RGBA
+    FRAME_FILE_NPY  // NumPy array of shape (frames, pixels, 4)
+};
+
+// Streams rendered frames of one output to a file
+class FrameWriter {
+    private:
+        FILE* file = nullptr;
+        FrameFileFormat format;
+        size_t pixel_length;
+        size_t num_frames;
+        PixelFormat pixel_format;
+        size_t frames_written = 0;
+
+        int write_npy_header();
+    public:
+        FrameWriter(FrameFileFormat format, size_t pixel_length, size_t num_frames, PixelFormat pixel_format) :
+            format(format), pixel_length(pixel_length), num_frames(num_frames), pixel_format(pixel_format) { }
+        ~FrameWriter() { this->close(); }
+        // Returns non-zero if the file could not be opened or the header written
+        int open(const std::string& filename);
+        // Returns non-zero if the frame does not match the header or could not be written
+        int write(const ChromaFrame& frame);
+        void close();
+        size_t get_frames_written() const { return this->frames_written; }
+};
+
+// .npy files are written as NumPy arrays, everything else as raw frames
+FrameFileFormat get_frame_file_format(const std::string& filename);
+
+#endif
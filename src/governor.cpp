@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <sstream>
+
+#include "governor.hpp"
+
+// Quality at each level, background rates are a fraction of the output's frame rate
+struct GovernorLevel {
+    int blur_radius;
+    size_t max_particles;
+    size_t min_step;
+    float background_fraction;
+};
+
+static const GovernorLevel governor_levels[GOVERNOR_LEVELS] = {
+    {MAX_BLUR_RADIUS, SIZE_MAX, 1, 0},
+    {2, SIZE_MAX, 1, 0.5},
+    {2, 1024, 2, 0.5},
+    {1, 256, 4, 0.25},
+    {0, 64, 8, 0.125},
+};
+
+bool parse_governor_knobs(const std::string& names, int& knobs) {
+    const std::string knob_names[] = {"blur", "particles", "resolution", "rate"};
+    std::string name;
+    std::istringstream stream(names);
+    knobs = 0;
+    while (stream >> name) {
+        name.erase(std::remove(name.begin(), name.end(), ','), name.end());
+        if (name.empty())
+            continue;
+        if (name == "all") {
+            knobs = KNOB_ALL;
+            continue;
+        }
+        auto found = std::find(std::begin(knob_names), std::end(knob_names), name);
+        if (found == std::end(knob_names))
+            return false;
+        knobs |= 1 << (found - std::begin(knob_names));
+    }
+    return true;
+}
+
+std::string governor_knobs_to_string(int knobs) {
+    const std::string knob_names[] = {"blur", "particles", "resolution", "rate"};
+    std::string names;
+    for (int i = 0; i < 4; i++) {
+        if (knobs & (1 << i))
+            names += (names.empty() ? "" : ", ") + knob_names[i];
+    }
+    return names.empty() ? "none" : names;
+}
+
+bool QualityGovernor::record(int64_t frame_ns) {
+    this->window_ns += frame_ns;
+    this->window_frames++;
+    if (this->window_frames < std::max(1.0, this->fps * GOVERNOR_WINDOW))
+        return false;
+
+    this->last_load = this->window_ns / 1e9 * this->fps / this->window_frames;
+    this->window_ns = 0;
+    this->window_frames = 0;
+    if (this->windows_since_up >= 0)
+        this->windows_since_up++;
+
+    if (this->last_load > GOVERNOR_HIGH && this->level < GOVERNOR_LEVELS - 1) {
+        // Stepping up was too much if it has to be undone before the next step up was due, wait longer next time
+        if (this->windows_since_up >= 0 && this->windows_since_up <= GOVERNOR_UP_WINDOWS)
+            this->up_windows = std::min(this->up_windows * 2, GOVERNOR_MAX_UP_WINDOWS);
+        this->level++;
+        this->low_windows = 0;
+        this->windows_since_up = -1;
+        return true;
+    }
+    if (this->last_load < GOVERNOR_LOW && this->level > 0) {
+        if (++this->low_windows < this->up_windows)
+            return false;
+        this->level--;
+        this->low_windows = 0;
+        this->windows_since_up = 0;
+        return true;
+    }
+    this->low_windows = 0;
+    return false;
+}
+
+void QualityGovernor::reset() {
+    this->level = 0;
+    this->window_ns = 0;
+    this->window_frames = 0;
+    this->low_windows = 0;
+    this->up_windows = GOVERNOR_UP_WINDOWS;
+    this->windows_since_up = -1;
+    this->last_load = 0;
+}
+
+ChromaQuality QualityGovernor::get_quality() const {
+    const GovernorLevel& settings = governor_levels[this->level];
+    ChromaQuality quality;
+    quality.level = this->level;
+    if (this->knobs & KNOB_BLUR)
+        quality.blur_radius = settings.blur_radius;
+    if (this->knobs & KNOB_PARTICLES)
+        quality.max_particles = settings.max_particles;
+    if (this->knobs & KNOB_RESOLUTION)
+        quality.min_step = settings.min_step;
+    if (this->knobs & KNOB_RATE)
+        quality.background_rate = settings.background_fraction * this->fps;
+    return quality;
+}
@@ -0,0 +1,63 @@
+#ifndef CHROMA_GOVERNOR_H
+#define CHROMA_GOVERNOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define MAX_BLUR_RADIUS 4
+
+// Knobs the quality governor turns down while frames run over budget, full quality by default
+struct ChromaQuality {
+    int level = 0;
+    int blur_radius = MAX_BLUR_RADIUS; // Pixels particle systems blur over
+    size_t max_particles = SIZE_MAX;   // Particle systems stop adding particles past this many
+    size_t min_step = 1;               // Layers draw at most one in min_step pixels and interpolate the rest
+    float background_rate = 0;         // Updates per second of layers below the top one, 0 for no limit
+};
+
+#define GOVERNOR_LEVELS 5
+#define GOVERNOR_HIGH 0.9          // Share of the frame budget above which quality steps down
+#define GOVERNOR_LOW 0.6           // Share of the frame budget below which quality steps back up
+#define GOVERNOR_WINDOW 0.25       // Seconds of frames averaged per decision
+#define GOVERNOR_UP_WINDOWS 12     // Windows in a row under GOVERNOR_LOW before stepping up
+#define GOVERNOR_MAX_UP_WINDOWS 96 // Longest wait after stepping up turned out to be too much
+
+enum GovernorKnob {
+    KNOB_BLUR = 1,       // Particle system blur radius
+    KNOB_PARTICLES = 2,  // Particle cap
+    KNOB_RESOLUTION = 4, // Pixels drawn per layer
+    KNOB_RATE = 8,       // Update rate of background layers
+    KNOB_ALL = 15
+};
+
+// Parses a list of knob names like "blur, particles", returns false on an unknown name
+bool parse_governor_knobs(const std::string& names, int& knobs);
+std::string governor_knobs_to_string(int knobs);
+
+// Steps an output's quality down while its frames take too much of the frame budget and back up,
+// more slowly, once there is headroom again
+class QualityGovernor {
+    private:
+        int fps;
+        int knobs = KNOB_ALL;
+        int level = 0;
+        int64_t window_ns = 0;
+        size_t window_frames = 0;
+        int low_windows = 0;
+        int up_windows = GOVERNOR_UP_WINDOWS;
+        int windows_since_up = -1; // -1 until the first step up
+        double last_load = 0;
+    public:
+        QualityGovernor(int fps) : fps(fps) { }
+        void set_knobs(int knobs) { this->knobs = knobs; }
+        // Adds the time the output spent on a frame, returns true if the quality level changed
+        bool record(int64_t frame_ns);
+        void reset();
+        int get_level() const { return this->level; }
+        // Mean share of the frame budget used over the last window
+        double get_load() const { return this->last_load; }
+        ChromaQuality get_quality() const;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "kernels_impl.hpp"
+
+// Each file's Ops stay local to it, the compositor has its own
+namespace {
+
+struct ScalarOps {
+    typedef float type;
+    static const size_t width = 1;
+    static type load(const float* p) { return *p; }
+    static void store(float* p, type v) { *p = v; }
+    static type set1(float f) { return f; }
+    static type add(type a, type b) { return a + b; }
+    static type sub(type a, type b) { return a - b; }
+    static type mul(type a, type b) { return a * b; }
+    static type neg(type a) { return -a; }
+    static type abs(type a) { return scalar_abs(a); }
+    static type max(type a, type b) { return scalar_max(a, b); }
+    static type min(type a, type b) { return scalar_min(a, b); }
+    static void store_bytes(uint8_t* p, type v) { *p = static_cast<int>(v); }
+    static void store_shorts(uint16_t* p, type v) { *p = static_cast<int>(v); }
+};
+
+}
+
+const SimdKernels SCALAR_KERNELS = KERNEL_TABLE("scalar", ScalarOps, to_half_kernel, from_half_kernel);
+
+static bool is_supported(const SimdKernels& kernels) {
+    if (kernels.add == nullptr)
+        return false;
+#if defined(__x86_64__) || defined(__i386__)
+    if (&kernels == &AVX512_KERNELS)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("f16c");
+    if (&kernels == &AVX2_KERNELS)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+    if (&kernels == &SSE2_KERNELS)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return true;
+}
+
+static const SimdKernels* const ALL_KERNELS[] = {&SCALAR_KERNELS, &SSE2_KERNELS, &AVX2_KERNELS, &AVX512_KERNELS};
+
+static const SimdKernels* select_kernels() {
+    for (int i = 3; i > 0; i--) {
+        if (is_supported(*ALL_KERNELS[i]))
+            return ALL_KERNELS[i];
+    }
+    return &SCALAR_KERNELS;
+}
+
+static std::atomic<const SimdKernels*> current_kernels = nullptr;
+
+const SimdKernels& get_kernels() {
+    const SimdKernels* kernels = current_kernels.load(std::memory_order_relaxed);
+    if (kernels == nullptr) {
+        kernels = select_kernels();
+        current_kernels = kernels;
+    }
+    return *kernels;
+}
+
+bool set_kernels(const std::string& isa) {
+    for (auto kernels : ALL_KERNELS) {
+        if (isa == kernels->isa && is_supported(*kernels)) {
+            current_kernels = kernels;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> get_supported_kernels() {
+    std::vector<std::string> names;
+    for (auto kernels : ALL_KERNELS) {
+        if (is_supported(*kernels))
+            names.push_back(kernels->isa);
+    }
+    return names;
+}
+
+GammaTable::GammaTable(float gamma) : gamma(gamma) {
+    for (int i = 0; i < GAMMA_TABLE_SIZE; i++)
+        this->table[i] = static_cast<int>(std::pow(i / (GAMMA_TABLE_SIZE - 1.0f), gamma) * 255 + 0.5f);
+}
+
+void GammaTable::apply(uint8_t* dst, const float* a, size_t n) const {
+    const SimdKernels& kernels = get_kernels();
+    if (this->gamma == 1) {
+        kernels.quantize(dst, a, n);
+        return;
+    }
+    uint16_t indices[1024];
+    for (size_t offset = 0; offset < n; offset += 1024) {
+        size_t len = std::min(n - offset, (size_t) 1024);
+        kernels.quantize_index(indices, a + offset, len);
+        for (size_t i = 0; i < len; i++)
+            dst[offset + i] = this->table[indices[i]];
+    }
+}
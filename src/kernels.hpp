@@ -0,0 +1,62 @@
+#ifndef CHROMA_KERNELS_H
+#define CHROMA_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// How a layer is composited onto the ones below it, the blend kernels implement each mode
+enum BlendMode {
+    BLEND_OVER, BLEND_ADD, BLEND_MULTIPLY, BLEND_MAX, BLEND_SCREEN
+};
+
+#define BLEND_MODES 5
+
+// Elementwise kernels over n floats. A span of n vec4 pixels is passed as 4 * n floats, since every
+// vec4 operator is applied to each component alike.
+struct SimdKernels {
+    const char* isa;
+    void (*add)(float* dst, const float* a, const float* b, size_t n);             // dst = a + b
+    void (*scale)(float* dst, const float* a, float s, size_t n);                  // dst = a * s
+    void (*lerp)(float* dst, const float* a, const float* b, const float* t, size_t n); // dst = a * (1 - t) + b * t
+    void (*tent)(float* dst, const float* a, size_t n);                            // dst = max(-abs(a - 1) + 1, 0), RainbowEffect's ramps
+    void (*clamp)(float* dst, const float* a, float lo, float hi, size_t n);       // dst = min(max(a, lo), hi)
+    void (*quantize)(uint8_t* dst, const float* a, size_t n);                      // dst = a clamped to [0, 1] * 255, truncated
+    void (*quantize_index)(uint16_t* dst, const float* a, size_t n);               // dst = a clamped to [0, 1] * 4095, rounded
+    void (*to_half)(uint16_t* dst, const float* a, size_t n);                      // IEEE half floats, rounded to nearest even
+    void (*from_half)(float* dst, const uint16_t* a, size_t n);
+    // Pixel kernels over n pixels of 4 floats, with alpha last
+    void (*blend[BLEND_MODES])(float* dst, const float* src, size_t n);                    // dst = src blended onto dst, indexed by BlendMode
+    void (*accumulate_over)(float* total, float* factors, const float* colors, size_t n); // total += colors * factors, factors *= 1 - colors alpha
+};
+
+// Entries of a GammaTable, indexed by quantize_index
+#define GAMMA_TABLE_SIZE 4096
+
+// Converts float channels to bytes with gamma correction applied through a lookup table
+class GammaTable {
+    private:
+        float gamma;
+        uint8_t table[GAMMA_TABLE_SIZE];
+    public:
+        GammaTable(float gamma = 1);
+        float get_gamma() const { return this->gamma; }
+        // Quantizes n floats, straight through the quantize kernel when gamma is 1
+        void apply(uint8_t* dst, const float* a, size_t n) const;
+};
+
+// Tables for each instruction set, with null kernels if it was not compiled in
+extern const SimdKernels SCALAR_KERNELS;
+extern const SimdKernels SSE2_KERNELS;
+extern const SimdKernels AVX2_KERNELS;
+extern const SimdKernels AVX512_KERNELS;
+
+// The widest kernels the CPU supports, picked on first use
+const SimdKernels& get_kernels();
+// Forces an instruction set by name, returns false if it is unknown or not supported by the CPU
+bool set_kernels(const std::string& isa);
+// Names of the instruction sets usable on this CPU, narrowest first
+std::vector<std::string> get_supported_kernels();
+
+#endif
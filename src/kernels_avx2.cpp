@@ -0,0 +1,54 @@
+#include "kernels_impl.hpp"
+
+// Built with -mavx2 -mf16c, see the Makefile
+#ifdef __AVX2__
+#include <immintrin.h>
+
+namespace {
+
+struct AVX2Ops {
+    typedef __m256 type;
+    static const size_t width = 8;
+    static type load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, type v) { _mm256_storeu_ps(p, v); }
+    static type set1(float f) { return _mm256_set1_ps(f); }
+    static type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    static type neg(type a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static type abs(type a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static type max(type a, type b) { return _mm256_max_ps(b, a); } // Operands swapped to match std::max with NaN
+    static type min(type a, type b) { return _mm256_min_ps(b, a); }
+    static type alpha(type v) { return _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3)); }
+    static type expand(const float* p) { return _mm256_setr_ps(p[0], p[0], p[0], p[0], p[1], p[1], p[1], p[1]); }
+    static void store_bytes(uint8_t* p, type v) {
+        __m256i ints = _mm256_cvttps_epi32(v);
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(ints), _mm256_extracti128_si256(ints, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(words, words));
+    }
+    static void store_shorts(uint16_t* p, type v) {
+        __m256i ints = _mm256_cvttps_epi32(v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_packus_epi32(_mm256_castsi256_si128(ints), _mm256_extracti128_si256(ints, 1)));
+    }
+};
+
+}
+
+static void f16c_to_half_kernel(uint16_t* dst, const float* a, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(a + i), _MM_FROUND_TO_NEAREST_INT));
+    to_half_kernel(dst + i, a + i, n - i);
+}
+
+static void f16c_from_half_kernel(float* dst, const uint16_t* a, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i))));
+    from_half_kernel(dst + i, a + i, n - i);
+}
+
+const SimdKernels AVX2_KERNELS = KERNEL_TABLE("avx2", AVX2Ops, f16c_to_half_kernel, f16c_from_half_kernel);
+#else
+const SimdKernels AVX2_KERNELS = { "avx2" };
+#endif
@@ -0,0 +1,52 @@
+#include "kernels_impl.hpp"
+
+// Built with -mavx512f -mf16c, see the Makefile
+#ifdef __AVX512F__
+#include <immintrin.h>
+
+// GCC warns about the undefined pass-through register inside _mm512_max_ps and _mm512_min_ps
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+namespace {
+
+struct AVX512Ops {
+    typedef __m512 type;
+    static const size_t width = 16;
+    static type load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, type v) { _mm512_storeu_ps(p, v); }
+    static type set1(float f) { return _mm512_set1_ps(f); }
+    static type add(type a, type b) { return _mm512_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm512_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm512_mul_ps(a, b); }
+    static type neg(type a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000))); }
+    static type abs(type a) { return _mm512_abs_ps(a); }
+    static type max(type a, type b) { return _mm512_max_ps(b, a); } // Operands swapped to match std::max with NaN
+    static type min(type a, type b) { return _mm512_min_ps(b, a); }
+    static type alpha(type v) { return _mm512_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3)); }
+    static type expand(const float* p) {
+        return _mm512_permutexvar_ps(_mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3), _mm512_castps128_ps512(_mm_loadu_ps(p)));
+    }
+    static void store_bytes(uint8_t* p, type v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm512_cvtusepi32_epi8(_mm512_cvttps_epi32(v))); }
+    static void store_shorts(uint16_t* p, type v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtusepi32_epi16(_mm512_cvttps_epi32(v))); }
+};
+
+}
+
+static void f16c_to_half_kernel(uint16_t* dst, const float* a, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm512_cvtps_ph(_mm512_loadu_ps(a + i), _MM_FROUND_TO_NEAREST_INT));
+    to_half_kernel(dst + i, a + i, n - i);
+}
+
+static void f16c_from_half_kernel(float* dst, const uint16_t* a, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i))));
+    from_half_kernel(dst + i, a + i, n - i);
+}
+
+const SimdKernels AVX512_KERNELS = KERNEL_TABLE("avx512", AVX512Ops, f16c_to_half_kernel, f16c_from_half_kernel);
+#else
+const SimdKernels AVX512_KERNELS = { "avx512" };
+#endif
@@ -0,0 +1,232 @@
+#ifndef CHROMA_KERNELS_IMPL_H
+#define CHROMA_KERNELS_IMPL_H
+
+// Included by one translation unit per instruction set, each compiled with its own target flags.
+// Everything here has internal linkage and avoids std templates, so no function compiled for a
+// wider instruction set can be merged into code that runs on every CPU.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "kernels.hpp"
+
+// Same results as std::abs, std::max and std::min, including which operand a NaN picks
+static inline float scalar_abs(float a) { return __builtin_fabsf(a); }
+static inline float scalar_max(float a, float b) { return a < b ? b : a; }
+static inline float scalar_min(float a, float b) { return b < a ? b : a; }
+
+// Ops wraps one SIMD register of floats, the scalar formulas finish the tail of each span
+template <class Ops>
+static void add_kernel(float* dst, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    for (; i + Ops::width <= n; i += Ops::width)
+        Ops::store(dst + i, Ops::add(Ops::load(a + i), Ops::load(b + i)));
+    for (; i < n; i++)
+        dst[i] = a[i] + b[i];
+}
+
+template <class Ops>
+static void scale_kernel(float* dst, const float* a, float s, size_t n) {
+    size_t i = 0;
+    auto factor = Ops::set1(s);
+    for (; i + Ops::width <= n; i += Ops::width)
+        Ops::store(dst + i, Ops::mul(Ops::load(a + i), factor));
+    for (; i < n; i++)
+        dst[i] = a[i] * s;
+}
+
+template <class Ops>
+static void lerp_kernel(float* dst, const float* a, const float* b, const float* t, size_t n) {
+    size_t i = 0;
+    auto one = Ops::set1(1);
+    for (; i + Ops::width <= n; i += Ops::width) {
+        auto lerp = Ops::load(t + i);
+        Ops::store(dst + i, Ops::add(Ops::mul(Ops::load(a + i), Ops::sub(one, lerp)), Ops::mul(Ops::load(b + i), lerp)));
+    }
+    for (; i < n; i++)
+        dst[i] = a[i] * (1 - t[i]) + b[i] * t[i];
+}
+
+template <class Ops>
+static void tent_kernel(float* dst, const float* a, size_t n) {
+    size_t i = 0;
+    auto one = Ops::set1(1);
+    auto zero = Ops::set1(0);
+    for (; i + Ops::width <= n; i += Ops::width)
+        Ops::store(dst + i, Ops::max(Ops::add(Ops::neg(Ops::abs(Ops::sub(Ops::load(a + i), one))), one), zero));
+    for (; i < n; i++)
+        dst[i] = scalar_max(-scalar_abs(a[i] - 1) + 1, 0);
+}
+
+template <class Ops>
+static void clamp_kernel(float* dst, const float* a, float lo, float hi, size_t n) {
+    size_t i = 0;
+    auto low = Ops::set1(lo);
+    auto high = Ops::set1(hi);
+    for (; i + Ops::width <= n; i += Ops::width)
+        Ops::store(dst + i, Ops::min(Ops::max(Ops::load(a + i), low), high));
+    for (; i < n; i++)
+        dst[i] = scalar_min(scalar_max(a[i], lo), hi);
+}
+
+// NaN becomes 0, since the max takes 0 first
+template <class Ops>
+static void quantize_kernel(uint8_t* dst, const float* a, size_t n) {
+    size_t i = 0;
+    auto zero = Ops::set1(0);
+    auto one = Ops::set1(1);
+    auto levels = Ops::set1(255);
+    for (; i + Ops::width <= n; i += Ops::width)
+        Ops::store_bytes(dst + i, Ops::mul(Ops::min(Ops::max(zero, Ops::load(a + i)), one), levels));
+    for (; i < n; i++)
+        dst[i] = static_cast<int>(scalar_min(scalar_max(0, a[i]), 1) * 255);
+}
+
+template <class Ops>
+static void quantize_index_kernel(uint16_t* dst, const float* a, size_t n) {
+    size_t i = 0;
+    auto zero = Ops::set1(0);
+    auto one = Ops::set1(1);
+    auto levels = Ops::set1(GAMMA_TABLE_SIZE - 1);
+    auto half = Ops::set1(0.5f);
+    for (; i + Ops::width <= n; i += Ops::width)
+        Ops::store_shorts(dst + i, Ops::add(Ops::mul(Ops::min(Ops::max(zero, Ops::load(a + i)), one), levels), half));
+    for (; i < n; i++)
+        dst[i] = static_cast<int>(scalar_min(scalar_max(0, a[i]), 1) * (GAMMA_TABLE_SIZE - 1) + 0.5f);
+}
+
+// Round to nearest even like F16C, after F. Giesen's float_to_half_fast3_rtne
+static inline uint16_t float_to_half(float f) {
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint16_t half;
+    if (x >= 0x47800000u) {
+        // Too large becomes infinity, NaNs stay quiet NaNs with their top mantissa bits
+        half = x > 0x7f800000u ? 0x7e00 | ((x >> 13) & 0x3ff) : 0x7c00;
+    }
+    else if (x < 0x38800000u) {
+        // Subnormal, let the float addition do the rounding
+        const uint32_t magic_bits = ((127 - 15) + (23 - 10) + 1) << 23;
+        float magic, value;
+        memcpy(&magic, &magic_bits, 4);
+        memcpy(&value, &x, 4);
+        value += magic;
+        memcpy(&x, &value, 4);
+        half = x - magic_bits;
+    }
+    else {
+        uint32_t odd = (x >> 13) & 1;
+        x += ((uint32_t) (15 - 127) << 23) + 0xfff + odd;
+        half = x >> 13;
+    }
+    return half | (sign >> 16);
+}
+
+static inline float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t x;
+    if (exponent == 0x1f)
+        x = sign | 0x7f800000u | (mantissa << 13) | (mantissa != 0 ? 0x400000u : 0); // NaNs come out quiet, like F16C
+    else if (exponent != 0)
+        x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        x = sign;
+    else {
+        // Subnormal, normalize the mantissa
+        exponent = 127 - 15 + 1;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+static void to_half_kernel(uint16_t* dst, const float* a, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = float_to_half(a[i]);
+}
+
+static void from_half_kernel(float* dst, const uint16_t* a, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = half_to_float(a[i]);
+}
+
+// Pixel kernels need Ops::alpha, which spreads the alpha of each pixel in a register over its four floats,
+// and Ops::expand, which loads one factor per pixel the same way. Ops narrower than a pixel only run the tail.
+template <class Ops, BlendMode mode>
+static inline typename Ops::type blend_pixels(typename Ops::type d, typename Ops::type s) {
+    auto one = Ops::set1(1);
+    if constexpr (mode == BLEND_OVER)
+        return Ops::add(s, Ops::mul(d, Ops::sub(one, Ops::alpha(s))));
+    else if constexpr (mode == BLEND_ADD)
+        return Ops::add(d, s);
+    else if constexpr (mode == BLEND_MULTIPLY)
+        return Ops::add(Ops::mul(s, d), Ops::add(Ops::mul(s, Ops::sub(one, Ops::alpha(d))), Ops::mul(d, Ops::sub(one, Ops::alpha(s)))));
+    else if constexpr (mode == BLEND_MAX)
+        return Ops::max(d, s);
+    else
+        return Ops::sub(Ops::add(s, d), Ops::mul(s, d));
+}
+
+template <BlendMode mode>
+static inline void blend_pixel(float* d, const float* s) {
+    float da = d[3];
+    float sa = s[3];
+    for (int c = 0; c < 4; c++) {
+        if constexpr (mode == BLEND_OVER)
+            d[c] = s[c] + d[c] * (1 - sa);
+        else if constexpr (mode == BLEND_ADD)
+            d[c] = d[c] + s[c];
+        else if constexpr (mode == BLEND_MULTIPLY)
+            d[c] = s[c] * d[c] + (s[c] * (1 - da) + d[c] * (1 - sa));
+        else if constexpr (mode == BLEND_MAX)
+            d[c] = scalar_max(d[c], s[c]);
+        else
+            d[c] = (s[c] + d[c]) - s[c] * d[c];
+    }
+}
+
+template <class Ops, BlendMode mode>
+static void blend_kernel(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+    if constexpr (Ops::width % 4 == 0) {
+        for (; i + Ops::width / 4 <= n; i += Ops::width / 4)
+            Ops::store(dst + i * 4, blend_pixels<Ops, mode>(Ops::load(dst + i * 4), Ops::load(src + i * 4)));
+    }
+    for (; i < n; i++)
+        blend_pixel<mode>(dst + i * 4, src + i * 4);
+}
+
+template <class Ops>
+static void accumulate_over_kernel(float* total, float* factors, const float* colors, size_t n) {
+    size_t i = 0;
+    if constexpr (Ops::width % 4 == 0) {
+        for (; i + Ops::width / 4 <= n; i += Ops::width / 4) {
+            Ops::store(total + i * 4, Ops::add(Ops::load(total + i * 4), Ops::mul(Ops::load(colors + i * 4), Ops::expand(factors + i))));
+            for (size_t j = i; j < i + Ops::width / 4; j++)
+                factors[j] *= 1 - colors[j * 4 + 3];
+        }
+    }
+    for (; i < n; i++) {
+        for (int c = 0; c < 4; c++)
+            total[i * 4 + c] += colors[i * 4 + c] * factors[i];
+        factors[i] *= 1 - colors[i * 4 + 3];
+    }
+}
+
+#define KERNEL_TABLE(isa, Ops, to_half, from_half) { isa, add_kernel<Ops>, scale_kernel<Ops>, lerp_kernel<Ops>, tent_kernel<Ops>, \
+    clamp_kernel<Ops>, quantize_kernel<Ops>, quantize_index_kernel<Ops>, to_half, from_half, \
+    { blend_kernel<Ops, BLEND_OVER>, blend_kernel<Ops, BLEND_ADD>, blend_kernel<Ops, BLEND_MULTIPLY>, blend_kernel<Ops, BLEND_MAX>, \
+        blend_kernel<Ops, BLEND_SCREEN> }, accumulate_over_kernel<Ops> }
+
+#endif
@@ -0,0 +1,40 @@
+#include "kernels_impl.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+namespace {
+
+struct SSE2Ops {
+    typedef __m128 type;
+    static const size_t width = 4;
+    static type load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, type v) { _mm_storeu_ps(p, v); }
+    static type set1(float f) { return _mm_set1_ps(f); }
+    static type add(type a, type b) { return _mm_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+    static type neg(type a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+    static type abs(type a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static type max(type a, type b) { return _mm_max_ps(b, a); } // Operands swapped to match std::max with NaN
+    static type min(type a, type b) { return _mm_min_ps(b, a); }
+    static type alpha(type v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)); }
+    static type expand(const float* p) { return _mm_set1_ps(*p); }
+    static void store_bytes(uint8_t* p, type v) {
+        __m128i words = _mm_packs_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128());
+        int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+        memcpy(p, &bytes, 4);
+    }
+    static void store_shorts(uint16_t* p, type v) {
+        __m128i words = _mm_cvttps_epi32(v);
+        // No unsigned 32 to 16 bit pack before SSE4.1, values are at most 4095 so the signed one does
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(words, words));
+    }
+};
+
+}
+
+const SimdKernels SSE2_KERNELS = KERNEL_TABLE("sse2", SSE2Ops, to_half_kernel, from_half_kernel);
+#else
+const SimdKernels SSE2_KERNELS = { "sse2" };
+#endif
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "layout.hpp"
+
+PixelLayout::PixelLayout(const std::string& name, std::vector<float> x, std::vector<float> y, std::vector<float> z) :
+    name(name), x(std::move(x)), y(std::move(y)), z(std::move(z)) {
+    std::vector<float>* axes[] = {&this->x, &this->y, &this->z};
+    float low[3] = {0, 0, 0};
+    float scale = 0;
+    for (int a = 0; a < 3; a++) {
+        std::vector<float>& values = *axes[a];
+        if (values.empty())
+            continue;
+        auto bounds = std::minmax_element(values.begin(), values.end());
+        low[a] = *bounds.first;
+        this->extent[a] = *bounds.second - *bounds.first;
+        scale = std::max(scale, this->extent[a]);
+    }
+    for (int a = 0; a < 3; a++) {
+        for (float& value : *axes[a])
+            value = scale > 0 ? (value - low[a]) / scale : 0;
+        this->extent[a] = scale > 0 ? this->extent[a] / scale : 0;
+    }
+}
+
+std::shared_ptr<PixelLayout> make_linear_layout(size_t pixel_length) {
+    std::vector<float> x(pixel_length);
+    for (size_t i = 0; i < pixel_length; i++)
+        x[i] = static_cast<float>(i) / pixel_length;
+    return std::make_shared<PixelLayout>("linear", x, std::vector<float>(pixel_length), std::vector<float>(pixel_length));
+}
+
+std::shared_ptr<PixelLayout> make_matrix_layout(size_t width, size_t height, bool serpentine) {
+    std::vector<float> x(width * height);
+    std::vector<float> y(width * height);
+    for (size_t row = 0; row < height; row++) {
+        for (size_t column = 0; column < width; column++) {
+            size_t i = row * width + (serpentine && row % 2 == 1 ? width - 1 - column : column);
+            x[i] = column;
+            y[i] = row;
+        }
+    }
+    return std::make_shared<PixelLayout>(serpentine ? "serpentine" : "matrix", x, y, std::vector<float>(width * height));
+}
+
+std::shared_ptr<PixelLayout> load_layout(const std::string& filename, std::string& error) {
+    std::ifstream file(filename);
+    if (!file) {
+        error = "Could not open " + filename;
+        return nullptr;
+    }
+    std::vector<float> x, y, z;
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); number++) {
+        line = line.substr(0, line.find('#'));
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream stream(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (stream >> field)
+            fields.push_back(field);
+        if (fields.empty())
+            continue; // Blank or comment
+
+        float coordinates[3] = {0, 0, 0};
+        bool valid = fields.size() == 2 || fields.size() == 3;
+        for (size_t i = 0; valid && i < fields.size(); i++) {
+            char* end;
+            coordinates[i] = std::strtof(fields[i].c_str(), &end);
+            valid = *end == '\0';
+        }
+        if (!valid) {
+            error = filename + ":" + std::to_string(number) + ": expected x y [z]";
+            return nullptr;
+        }
+        x.push_back(coordinates[0]);
+        y.push_back(coordinates[1]);
+        z.push_back(coordinates[2]);
+    }
+    if (x.empty()) {
+        error = filename + " has no pixels";
+        return nullptr;
+    }
+    return std::make_shared<PixelLayout>(filename, x, y, z);
+}
@@ -0,0 +1,42 @@
+#ifndef CHROMA_LAYOUT_H
+#define CHROMA_LAYOUT_H
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Position of every pixel of an output, kept as separate x, y and z arrays so effects can stream one axis.
+// Coordinates are scaled uniformly so the longest side of the bounding box spans 0 to 1, starting at 0 on every axis.
+class PixelLayout {
+    private:
+        std::string name;
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        float extent[3] = {0, 0, 0}; // Size of the bounding box after scaling
+    public:
+        PixelLayout(const std::string& name, std::vector<float> x, std::vector<float> y, std::vector<float> z);
+        const std::string& get_name() const { return this->name; }
+        size_t size() const { return this->x.size(); }
+        const float* get_x() const { return this->x.data(); }
+        const float* get_y() const { return this->y.data(); }
+        const float* get_z() const { return this->z.data(); }
+        float get_extent(int axis) const { return this->extent[axis]; }
+        // Pixel drawn at an index as effects see it, the nearest one for transformed indices
+        size_t get_pixel(float index) const {
+            if (!(index > 0))
+                return 0;
+            return std::min(this->x.size() - 1, static_cast<size_t>(std::lround(index * this->x.size())));
+        }
+};
+
+// Pixels in a straight line, the layout of an output until it is given another one
+std::shared_ptr<PixelLayout> make_linear_layout(size_t pixel_length);
+// Rows of width pixels, every other row running backwards if serpentine
+std::shared_ptr<PixelLayout> make_matrix_layout(size_t width, size_t height, bool serpentine);
+// Reads one "x y [z]" line per pixel, separated by spaces or commas, # starts a comment.
+// Returns nullptr and sets error if the file cannot be read.
+std::shared_ptr<PixelLayout> load_layout(const std::string& filename, std::string& error);
+
+#endif
@@ -6,6 +6,8 @@
 #include <math.h>
 #include <thread>
 #include <fstream>
+#include <chrono>
+#include <cmath>
 
 #ifdef _WIN32
 #include <io.h>
@@ -16,6 +18,8 @@
 
 #include "chroma.hpp"
 #include "chromatic.hpp"
+#include "compositor.hpp"
+#include "kernels.hpp"
 #include "chroma_script.hpp"
 #include "chroma_cli.hpp"
 #include "commands.hpp"
@@ -23,6 +27,7 @@
 #include "effects.hpp"
 #include "particles.hpp"
 #include "disco.hpp"
+#include "frame_writer.hpp"
 #include "web_server.hpp"
 
 // TODO: potential optimization, use string_view for read-only strings
@@ -80,6 +85,17 @@ const auto WHEEL_CMD = CommandBuilder<WheelEffect>("wheel")
     .add_argument("EFFECT", OBJECT_TYPE, "effect to spin")
     .add_argument("PERIOD", NUMBER_TYPE, "period of the spin")
     .set_description("Spins the effect across the strip like a wheel (wave-like version of wipe)");
+const auto SWEEP_CMD = CommandBuilder<SweepEffect>("sweep")
+    .add_argument("EFFECT", OBJECT_TYPE, "effect to draw across the layout")
+    .add_argument("ANGLE", NUMBER_TYPE, "direction in degrees, 0 along the rows of a matrix and 90 down its columns")
+    .add_optional_argument("ELEVATION", NUMBER_TYPE, "degrees the direction tilts towards z on a 3D layout, 0 by default and 90 straight up")
+    .set_description("Draws an effect across the output's layout in a direction instead of along the strip");
+const auto RADIAL_CMD = CommandBuilder<RadialEffect>("radial")
+    .add_argument("EFFECT", OBJECT_TYPE, "effect to draw outwards")
+    .add_optional_argument("X", NUMBER_TYPE, "center across the layout, 0 to 1, 0.5 by default")
+    .add_optional_argument("Y", NUMBER_TYPE, "center down the layout, 0 to 1, 0.5 by default")
+    .add_optional_argument("Z", NUMBER_TYPE, "center through the depth of a 3D layout, 0 to 1, 0.5 by default")
+    .set_description("Draws an effect outwards from a point of the output's layout");
 
 
 const auto PBODY_CMD = CommandBuilder<PhysicsBody>("pbody")
@@ -119,44 +135,375 @@ const auto SET_LAYER_CMD = LambdaAdapter("setlayer", "Set current layer in the C
         std::make_shared<TypeArgument>("INDEX", NUMBER_TYPE, "index (starting from 0) of the layer")
     }),
     [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
-        env.controller->set_current_layer(args[0].get_int());
+        if (args[0].get_int() < 0 || !env.controller->set_current_layer(args[0].get_int()))
+            throw ChromaRuntimeException("No layer at that index, add one with addlayer first");
         std::cerr << "Set layer: " << env.controller->get_current_layer() << " of " << env.controller->get_num_layers() << std::endl;
         return ChromaData();
     }
 );
 
-const auto EXIT_CMD = LambdaAdapter("exit", "Exits the program", std::vector<std::shared_ptr<CommandArgument>>(),
+const auto BLEND_CMD = LambdaAdapter("blend", "Set how the current layer blends with the layers below it", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("MODE", STRING_TYPE, "one of \"over\", \"add\", \"multiply\", \"max\" or \"screen\"")
+    }),
     [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
-        env.controller->stop();
+        BlendMode mode;
+        if (!parse_blend_mode(args[0].get_string(), mode))
+            throw ChromaRuntimeException("Unknown blend mode, expected \"over\", \"add\", \"multiply\", \"max\" or \"screen\"");
+        env.controller->set_blend_mode(mode);
+        std::cerr << "Set layer " << env.controller->get_current_layer() << " blend mode: " << blend_mode_to_string(mode) << std::endl;
         return ChromaData();
     }
 );
 
-void callback(const std::vector<vec4>& pixels) {
-    const int n = 150;
-    vec4 buffer[n] = {0};
-    std::copy(pixels.begin(), pixels.end(), buffer);
-    fwrite(buffer, 16, n, stdout);
-}
+const auto LAYER_RATE_CMD = LambdaAdapter("layerrate", "Set how often the current layer updates, frames in between blend its last two updates", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("RATE", NUMBER_TYPE, "updates per second, 0 to update every frame, or leave out to use the rate the layer's effect asks for", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        float rate = args.size() > 0 ? args[0].get_float() : LAYER_RATE_AUTO;
+        if (args.size() > 0 && rate < 0)
+            throw ChromaRuntimeException("RATE must not be negative");
+        env.controller->set_update_rate(rate);
+        if (rate == LAYER_RATE_AUTO)
+            std::cerr << "Set layer " << env.controller->get_current_layer() << " update rate: auto" << std::endl;
+        else
+            std::cerr << "Set layer " << env.controller->get_current_layer() << " update rate: " << rate << std::endl;
+        return ChromaData();
+    }
+);
 
-int main() {
-#ifdef _WIN32
-    WSADATA wsaData;
-    int res = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (res != NO_ERROR) {
-        fprintf(stderr, "WSAStartup failed with error %d\n", res);
-        return 1;
+const auto LAYER_RESOLUTION_CMD = LambdaAdapter("layerres", "Draw the current layer at a fraction of the pixels and interpolate the rest", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("FRACTION", NUMBER_TYPE, "fraction of the pixels to draw, 1 for all of them or 0 for the fewest that look the same"),
+        std::make_shared<TypeArgument>("INTERPOLATION", STRING_TYPE, "\"linear\" or \"cubic\", linear by default", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        float resolution = args[0].get_float();
+        if (resolution < 0 || resolution > 1)
+            throw ChromaRuntimeException("FRACTION must be between 0 and 1");
+        Interpolation interpolation = INTERPOLATE_LINEAR;
+        if (args.size() > 1 && args[1].get_string() == "cubic")
+            interpolation = INTERPOLATE_CUBIC;
+        else if (args.size() > 1 && args[1].get_string() != "linear")
+            throw ChromaRuntimeException("Unknown interpolation, expected linear or cubic");
+        env.controller->set_resolution(resolution, interpolation);
+        return ChromaData();
     }
-#endif
-    ChromaController controller;
-    ChromaEnvironment cenv;
-    cenv.controller = &controller;
+);
 
-    auto config_manager = std::make_unique<DictionaryConfigManager>();
-    UDPDisco disco(std::move(config_manager));
+const auto BAKE_CMD = LambdaAdapter("bake", "Draw one period of the current layer ahead of time and play it back in a loop", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("PERIOD", NUMBER_TYPE, "seconds the layer repeats after, 0 to draw it live again, or leave out to use the period of the layer's effect", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        float period = args.size() > 0 ? args[0].get_float() : LAYER_BAKE_AUTO;
+        if (args.size() > 0 && period < 0)
+            throw ChromaRuntimeException("PERIOD must not be negative");
+        env.controller->set_bake_period(period);
+        if (period == LAYER_BAKE_OFF)
+            std::cerr << "Drawing layer " << env.controller->get_current_layer() << " live" << std::endl;
+        return ChromaData();
+    }
+);
 
-    ChromaCLI cli(cenv, disco);
+const auto BAKE_MEMORY_CMD = LambdaAdapter("bakememory", "Set how much memory the current output's baked loops may take", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("MEGABYTES", NUMBER_TYPE, "memory for the baked loops of all layers, loops that do not fit are drawn live")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        float megabytes = args[0].get_float();
+        if (megabytes < 0)
+            throw ChromaRuntimeException("MEGABYTES must not be negative");
+        env.controller->get_current_output().set_bake_memory(static_cast<size_t>(megabytes * 1048576));
+        return ChromaData();
+    }
+);
+
+const auto ADD_OUTPUT_CMD = LambdaAdapter("addoutput", "Add a new output device to the Chroma Controller and make it current", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("ID", STRING_TYPE, "component id of the Disco device to send to"),
+        std::make_shared<TypeArgument>("PIXELS", NUMBER_TYPE, "number of pixels on the device"),
+        std::make_shared<TypeArgument>("FPS", NUMBER_TYPE, "frame rate to render the device at", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        int fps = args.size() > 2 ? args[2].get_int() : 60;
+        if (args[1].get_int() < 1 || fps < 1)
+            throw ChromaRuntimeException("Pixel count and frame rate must be at least 1");
+        if (!env.controller->add_output(args[0].get_string(), args[1].get_int(), fps))
+            throw ChromaRuntimeException("An output with that id already exists, switch to it with setoutput");
+        std::cerr << "Added output: " << env.controller->get_component_id() << std::endl;
+        return ChromaData();
+    }
+);
+
+const auto SET_OUTPUT_CMD = LambdaAdapter("setoutput", "Set the current output device of the Chroma Controller", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("ID", STRING_TYPE, "component id of the output")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        if (!env.controller->set_current_output(args[0].get_string()))
+            throw ChromaRuntimeException("No output with that id, add it with addoutput first");
+        std::cerr << "Set output: " << env.controller->get_component_id() << std::endl;
+        return ChromaData();
+    }
+);
+
+const auto LIST_OUTPUTS_CMD = LambdaAdapter("outputs", "List the output devices of the Chroma Controller", std::vector<std::shared_ptr<CommandArgument>>(),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        for (auto& output : env.controller->get_outputs()) {
+            std::cerr << "- " << output->get_component_id() << " - pixels: " << output->get_pixel_length() << 
+                ", fps: " << output->get_fps() << ", layers: " << output->get_num_layers() <<
+                ", layout: " << output->get_layout()->get_name() << 
+                (output->is_idle() ? ", idle" : "") << std::endl;
+        }
+        return ChromaData();
+    }
+);
+
+const auto LAYOUT_CMD = LambdaAdapter("layout", "Set where the current output's pixels are", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("TYPE", STRING_TYPE, "\"linear\" for a strip, \"matrix\" for rows or \"serpentine\" for rows wired back and forth"),
+        std::make_shared<TypeArgument>("WIDTH", NUMBER_TYPE, "pixels per row of a matrix", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        ChromaOutput& output = env.controller->get_current_output();
+        std::string type = args[0].get_string();
+        std::shared_ptr<PixelLayout> layout;
+        if (type == "linear")
+            layout = make_linear_layout(output.get_pixel_length());
+        else if (type == "matrix" || type == "serpentine") {
+            if (args.size() < 2 || args[1].get_int() < 1 || output.get_pixel_length() % args[1].get_int() != 0)
+                throw ChromaRuntimeException("WIDTH must divide the output's pixel count");
+            size_t width = args[1].get_int();
+            layout = make_matrix_layout(width, output.get_pixel_length() / width, type == "serpentine");
+        }
+        else
+            throw ChromaRuntimeException("Unknown layout, expected linear, matrix or serpentine");
+        output.set_layout(layout);
+        return ChromaData();
+    }
+);
+
+const auto LAYOUT_FILE_CMD = LambdaAdapter("layoutfile", "Load where the current output's pixels are from a file", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("FILE", STRING_TYPE, "file with one \"x y [z]\" line per pixel, in wiring order")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        std::string error;
+        std::shared_ptr<PixelLayout> layout = load_layout(args[0].get_string(), error);
+        if (layout == nullptr)
+            throw ChromaRuntimeException(error.c_str());
+        if (!env.controller->get_current_output().set_layout(layout))
+            throw ChromaRuntimeException("The file must have a line for every pixel of the output");
+        std::cerr << "Loaded a layout of " << layout->size() << " pixels" << std::endl;
+        return ChromaData();
+    }
+);
+
+const auto THREADS_CMD = LambdaAdapter("threads", "Set the number of render threads used by the Chroma Controller", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("COUNT", NUMBER_TYPE, "number of threads, including the controller thread")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        if (args[0].get_int() < 1)
+            throw ChromaRuntimeException("Thread count must be at least 1");
+        env.controller->set_num_threads(args[0].get_int());
+        std::cerr << "Set render threads: " << env.controller->get_num_threads() << std::endl;
+        return ChromaData();
+    }
+);
+
+const auto FRAME_POLICY_CMD = LambdaAdapter("framepolicy", "Set how the Chroma Controller handles missed frame deadlines", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("POLICY", STRING_TYPE, "\"skip\" to drop missed frames or \"catchup\" to render them back to back")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        std::string policy = args[0].get_string();
+        if (policy == "skip")
+            env.controller->set_frame_policy(SKIP_MISSED);
+        else if (policy == "catchup")
+            env.controller->set_frame_policy(CATCH_UP);
+        else
+            throw ChromaRuntimeException("Unknown frame policy, expected \"skip\" or \"catchup\"");
+        return ChromaData();
+    }
+);
+
+const auto REALTIME_CMD = LambdaAdapter("realtime", "Configure real-time scheduling of the render, send and render pool threads", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("PRIORITY", NUMBER_TYPE, "SCHED_FIFO priority 1-99, 0 to use the default scheduler"),
+        std::make_shared<TypeArgument>("CPU", NUMBER_TYPE, "CPU to pin the render thread to, -1 for no pinning", true),
+        std::make_shared<TypeArgument>("MLOCK", NUMBER_TYPE, "1 to lock the process memory, 0 otherwise", true),
+        std::make_shared<TypeArgument>("SEND_CPU", NUMBER_TYPE, "CPU to pin the send thread to, -1 for no pinning", true),
+        std::make_shared<TypeArgument>("WORKER_CPU", NUMBER_TYPE, "first of the consecutive CPUs to pin the render pool's workers to, -1 for no pinning", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        RealtimeConfig config;
+        config.priority = args[0].get_int();
+        if (args.size() > 1)
+            config.render_cpu = args[1].get_int();
+        if (args.size() > 2)
+            config.lock_memory = args[2].get_int() != 0;
+        if (args.size() > 3)
+            config.send_cpu = args[3].get_int();
+        if (args.size() > 4)
+            config.worker_cpu = args[4].get_int();
+        env.controller->set_realtime(config);
+        return ChromaData();
+    }
+);
+
+const auto PIPELINE_CMD = LambdaAdapter("pipeline", "Turn pipelined frame sending on or off", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("ENABLED", NUMBER_TYPE, "1 to send frames on a separate thread, 0 to send them inline")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        env.controller->set_pipelined(args[0].get_int() != 0);
+        return ChromaData();
+    }
+);
+
+const auto COMPILE_CMD = LambdaAdapter("compile", "Turn compiling effects into flat programs on or off", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("ENABLED", NUMBER_TYPE, "1 to draw compiled programs, 0 to draw the effect trees directly")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        env.controller->set_compiled(args[0].get_int() != 0);
+        return ChromaData();
+    }
+);
+
+const auto SIMD_CMD = LambdaAdapter("simd", "Print or set the instruction set used by the pixel kernels", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("ISA", STRING_TYPE, "scalar, sse2, avx2 or avx512, prints the current and supported ones if not given", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        if (args.size() > 0) {
+            if (!set_kernels(args[0].get_string()))
+                throw ChromaRuntimeException("Instruction set is unknown or not supported by this CPU");
+            return ChromaData();
+        }
+        std::cerr << "Using " << get_kernels().isa << ", supported:";
+        for (auto& isa : get_supported_kernels())
+            std::cerr << " " << isa;
+        std::cerr << std::endl;
+        return ChromaData();
+    }
+);
 
+const auto FRAME_FORMAT_CMD = LambdaAdapter("frameformat", "Set the pixel format of the current output's frames", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("FORMAT", STRING_TYPE, "float, or byte to quantize frames to 8-bit RGBA on the render threads")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        std::string format = args[0].get_string();
+        if (format == "float")
+            env.controller->get_current_output().set_frame_format(PIXEL_FLOAT);
+        else if (format == "byte")
+            env.controller->get_current_output().set_frame_format(PIXEL_BYTE);
+        else
+            throw ChromaRuntimeException("Unknown frame format, expected float or byte");
+        return ChromaData();
+    }
+);
+
+const auto CACHE_FORMAT_CMD = LambdaAdapter("cacheformat", "Set the pixel format of the current output's cached layers", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("FORMAT", STRING_TYPE, "float, or half to store them as 16-bit floats")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        std::string format = args[0].get_string();
+        if (format == "float")
+            env.controller->get_current_output().set_cache_format(PIXEL_FLOAT);
+        else if (format == "half")
+            env.controller->get_current_output().set_cache_format(PIXEL_HALF);
+        else
+            throw ChromaRuntimeException("Unknown cache format, expected float or half");
+        return ChromaData();
+    }
+);
+
+const auto GAMMA_CMD = LambdaAdapter("gamma", "Set the gamma of the current output, applied when frames are quantized to bytes", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("GAMMA", NUMBER_TYPE, "exponent applied to every channel, 1 for none")
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        if (args[0].get_float() <= 0)
+            throw ChromaRuntimeException("GAMMA must be positive");
+        env.controller->get_current_output().set_gamma(args[0].get_float());
+        return ChromaData();
+    }
+);
+
+const auto IDLE_CMD = LambdaAdapter("idle", "Turn idling on or off, outputs with static layers stop rendering until their layers change", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("ENABLED", NUMBER_TYPE, "1 to idle while static, 0 to always render at full rate"),
+        std::make_shared<TypeArgument>("KEEPALIVE", NUMBER_TYPE, "seconds between refresh frames while idle, 1 by default", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        float keepalive = args.size() > 1 ? args[1].get_float() : 1;
+        if (keepalive <= 0)
+            throw ChromaRuntimeException("KEEPALIVE must be positive");
+        env.controller->set_idle(args[0].get_int() != 0, keepalive);
+        return ChromaData();
+    }
+);
+
+const auto CLOCK_CMD = LambdaAdapter("clock", "Set the clock the Chroma Controller animates with", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("TYPE", STRING_TYPE, "\"monotonic\" for real time, \"stepped\" to advance a fixed step per frame or \"virtual\" to only move when set"),
+        std::make_shared<TypeArgument>("VALUE", NUMBER_TYPE, "seconds per frame for stepped, one frame of each output by default, or the time in seconds for virtual", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        std::string type = args[0].get_string();
+        float value = args.size() > 1 ? args[1].get_float() : 0;
+        if (value < 0)
+            throw ChromaRuntimeException("VALUE must not be negative");
+        if (type == "monotonic")
+            env.controller->set_clock(std::make_shared<MonotonicClock>());
+        else if (type == "stepped")
+            env.controller->set_clock(std::make_shared<SteppedClock>(static_cast<int64_t>(value * 1e9)));
+        else if (type == "virtual") {
+            // Move the current virtual clock instead of restarting the outputs' frame counts
+            auto clock = std::dynamic_pointer_cast<VirtualClock>(env.controller->get_clock());
+            if (clock != nullptr)
+                clock->set_time_ns(value * 1e9);
+            else
+                env.controller->set_clock(std::make_shared<VirtualClock>(value * 1e9));
+        }
+        else
+            throw ChromaRuntimeException("Unknown clock, expected \"monotonic\", \"stepped\" or \"virtual\"");
+        return ChromaData();
+    }
+);
+
+const auto GOVERNOR_CMD = LambdaAdapter("governor", "Turn the quality governor on or off, it lowers quality while frames run over budget", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("ENABLED", NUMBER_TYPE, "1 to lower quality under load, 0 to always render at full quality"),
+        std::make_shared<TypeArgument>("KNOBS", STRING_TYPE, "what may be lowered out of \"blur\", \"particles\", \"resolution\" and \"rate\", all of them by default", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        int knobs = KNOB_ALL;
+        if (args.size() > 1 && !parse_governor_knobs(args[1].get_string(), knobs))
+            throw ChromaRuntimeException("Unknown knob, expected blur, particles, resolution or rate");
+        env.controller->set_governor(args[0].get_int() != 0, knobs);
+        std::cerr << "Quality governor " << (args[0].get_int() != 0 ? "on" : "off") << ", knobs: " << governor_knobs_to_string(knobs) << std::endl;
+        return ChromaData();
+    }
+);
+
+const auto PROFILE_CMD = LambdaAdapter("profile", "Profile the effect trees of every output, or print the results so far", std::vector<std::shared_ptr<CommandArgument>>({
+        std::make_shared<TypeArgument>("ENABLED", NUMBER_TYPE, "1 to start profiling from scratch, 0 to stop, prints the results if not given", true)
+    }),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        if (args.size() > 0) {
+            env.controller->set_profiling(args[0].get_int() != 0);
+            return ChromaData();
+        }
+        for (auto& output : env.controller->get_outputs())
+            std::cerr << output->get_component_id() << " - " << output->get_profiler().to_string();
+        return ChromaData();
+    }
+);
+
+const auto FRAME_STATS_CMD = LambdaAdapter("framestats", "Print frame pacing statistics of the Chroma Controller", std::vector<std::shared_ptr<CommandArgument>>(),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        for (auto& output : env.controller->get_outputs()) {
+            std::cerr << output->get_component_id() << " - " << output->get_frame_stats().to_string() << std::endl;
+            std::cerr << "\t" << output->get_frame_times() << std::endl;
+        }
+        return ChromaData();
+    }
+);
+
+const auto EXIT_CMD = LambdaAdapter("exit", "Exits the program", std::vector<std::shared_ptr<CommandArgument>>(),
+    [](const std::vector<ChromaData>& args, ChromaEnvironment& env) {
+        env.controller->stop();
+        return ChromaData();
+    }
+);
+
+void register_commands(ChromaCLI& cli) {
     cli.register_command(RGB_CMD);
     cli.register_command(ALPHA_CMD);
     cli.register_command(SPLIT_CMD);
@@ -171,6 +518,8 @@ int main() {
     cli.register_command(FADEOUT_CMD);
     cli.register_command(WAVE_CMD);
     cli.register_command(WHEEL_CMD);
+    cli.register_command(SWEEP_CMD);
+    cli.register_command(RADIAL_CMD);
 
     cli.register_command(PBODY_CMD);
     cli.register_command(PARTICLE_CMD);
@@ -180,17 +529,128 @@ int main() {
 
     cli.register_command(ADD_LAYER_CMD);
     cli.register_command(SET_LAYER_CMD);
+    cli.register_command(BLEND_CMD);
+    cli.register_command(LAYER_RATE_CMD);
+    cli.register_command(LAYER_RESOLUTION_CMD);
+    cli.register_command(BAKE_CMD);
+    cli.register_command(BAKE_MEMORY_CMD);
+    cli.register_command(ADD_OUTPUT_CMD);
+    cli.register_command(SET_OUTPUT_CMD);
+    cli.register_command(LIST_OUTPUTS_CMD);
+    cli.register_command(LAYOUT_CMD);
+    cli.register_command(LAYOUT_FILE_CMD);
+    cli.register_command(THREADS_CMD);
+    cli.register_command(FRAME_POLICY_CMD);
+    cli.register_command(REALTIME_CMD);
+    cli.register_command(PIPELINE_CMD);
+    cli.register_command(IDLE_CMD);
+    cli.register_command(COMPILE_CMD);
+    cli.register_command(SIMD_CMD);
+    cli.register_command(FRAME_FORMAT_CMD);
+    cli.register_command(CACHE_FORMAT_CMD);
+    cli.register_command(GAMMA_CMD);
+    cli.register_command(CLOCK_CMD);
+    cli.register_command(GOVERNOR_CMD);
+    cli.register_command(PROFILE_CMD);
+    cli.register_command(FRAME_STATS_CMD);
     cli.register_command(EXIT_CMD);
+}
+
+// chroma render SCRIPT PIXELS FPS DURATION OUTPUT
+// Renders the script without a Disco device as fast as possible and writes the frames to OUTPUT
+int render_main(int argc, char** argv, ChromaController& controller, ChromaCLI& cli) {
+    if (argc != 7) {
+        fprintf(stderr, "Usage: %s render SCRIPT PIXELS FPS DURATION OUTPUT\n", argv[0]);
+        fprintf(stderr, "OUTPUT ending in .npy is written as a NumPy array of shape (frames, pixels, 4), anything else as raw frames\n");
+        return 1;
+    }
+    std::string script = argv[2];
+    int pixels = atoi(argv[3]);
+    int fps = atoi(argv[4]);
+    double duration = atof(argv[5]);
+    std::string filename = argv[6];
+    if (pixels < 1 || fps < 1 || duration <= 0) {
+        fprintf(stderr, "PIXELS and FPS must be at least 1 and DURATION positive\n");
+        return 1;
+    }
+    if (!std::ifstream(script).good()) {
+        fprintf(stderr, "Could not open %s\n", script.c_str());
+        return 1;
+    }
+
+    // The script runs against the render output, so frameformat, gamma and layers apply to it
+    controller.add_output("render", pixels, fps);
+    cli.read_script_file(script);
+    ChromaOutput& output = controller.get_current_output();
+
+    size_t frames = std::llround(duration * output.get_fps());
+    FrameWriter writer(get_frame_file_format(filename), output.get_pixel_length(), frames, output.get_frame_format());
+    if (writer.open(filename) != 0)
+        return 1;
+
+    auto start = std::chrono::steady_clock::now();
+    int result = controller.render_offline(output, frames, [&](const ChromaOutput& output, const ChromaFrame& frame){
+        return writer.write(frame);
+    });
+    writer.close();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (result != 0) {
+        fprintf(stderr, "Failed to write %s\n", filename.c_str());
+        return 1;
+    }
+    fprintf(stderr, "Rendered %zu frames of %zu pixels in %.3f s (%.1fx real time)\n", frames, output.get_pixel_length(),
+        elapsed, frames / (double) output.get_fps() / std::max(elapsed, 1e-9));
+    return 0;
+}
+
+int main(int argc, char** argv) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    int res = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (res != NO_ERROR) {
+        fprintf(stderr, "WSAStartup failed with error %d\n", res);
+        return 1;
+    }
+#endif
+    ChromaController controller;
+    ChromaEnvironment cenv;
+    cenv.controller = &controller;
+
+    auto config_manager = std::make_unique<DictionaryConfigManager>();
+    DiscoConfigManager& manager = *config_manager; // Owned by disco once moved
+    UDPDisco disco(std::move(config_manager));
+
+    ChromaCLI cli(cenv, disco);
+
+    register_commands(cli);
+
+    if (argc > 1 && std::string(argv[1]) == "render")
+        return render_main(argc, argv, controller, cli);
+
+    // The web server is off unless asked for, and even then only serves metrics and profiles
+    int metrics_port = 0;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--metrics-port")
+            metrics_port = atoi(argv[i + 1]);
+    }
 
     fprintf(stderr, "Ready to start...\n"); // TODO: do proper logging
 
-    ChromaWebServer web_server(controller, cli, *config_manager, 80);
-    
     mDNSDiscoverer discoverer(disco);
     if (discoverer.run() != 0)
         return 1;
-    
-    // web_server.start();
+
+    // Rendering goes on without it if the port cannot be bound
+    std::unique_ptr<ChromaWebServer> web_server;
+    if (metrics_port > 0) {
+        web_server = std::make_unique<ChromaWebServer>(controller, cli, manager, metrics_port);
+        try {
+            web_server->start_read_only();
+        }
+        catch (const std::exception& e) {
+            fprintf(stderr, "HTTP server failed to start: %s\n", e.what());
+        }
+    }
 
     // fprintf(stderr, "Waiting for Disco config...\n");
     // httpServer->wait_for_any_config();
@@ -0,0 +1,84 @@
+#include <cstring>
+#include <unordered_set>
+
+#include "memo.hpp"
+
+// Last span a shared effect drew on one render thread
+struct SpanMemo {
+    uint64_t frame = 0;
+    double time = 0;
+    size_t n = 0;
+    float indices[CHROMA_SPAN_MAX];
+    vec4 colors[CHROMA_SPAN_MAX];
+};
+
+SharedEffects::SharedEffects(std::vector<const ChromaEffect*> effects) : effects(std::move(effects)) {
+    std::sort(this->effects.begin(), this->effects.end());
+    this->effects.erase(std::unique(this->effects.begin(), this->effects.end()), this->effects.end());
+    this->ticked.assign(this->effects.size(), 0);
+}
+
+std::shared_ptr<const SharedEffects> SharedEffects::find(const LayerStack& layers) {
+    std::unordered_set<const ChromaEffect*> visited;
+    std::vector<const ChromaEffect*> pending;
+    std::vector<const ChromaEffect*> shared;
+    for (const ChromaLayer& layer : layers) {
+        if (layer.effect != nullptr)
+            pending.push_back(layer.effect.get());
+    }
+    while (!pending.empty()) {
+        const ChromaEffect* effect = pending.back();
+        pending.pop_back();
+        // Children of a shared effect are only reached through it, so it ticking once ticks them once
+        if (!visited.insert(effect).second) {
+            shared.push_back(effect);
+            continue;
+        }
+        for (const ChromaEffect* child : effect->get_children())
+            pending.push_back(child);
+    }
+    if (shared.empty())
+        return nullptr;
+    return std::make_shared<SharedEffects>(std::move(shared));
+}
+
+size_t SharedEffects::index_of(const ChromaEffect* effect) const {
+    auto it = std::lower_bound(this->effects.begin(), this->effects.end(), effect);
+    if (it == this->effects.end() || *it != effect)
+        return SIZE_MAX;
+    return it - this->effects.begin();
+}
+
+bool SharedEffects::claim_tick(const ChromaEffect* effect, uint64_t frame) const {
+    size_t index = this->index_of(effect);
+    if (index == SIZE_MAX)
+        return true;
+    if (this->ticked[index] == frame)
+        return false;
+    this->ticked[index] = frame;
+    return true;
+}
+
+void ChromaEffect::draw_child(const ChromaEffect& child, const float* indices, vec4* out, size_t n, const ChromaState& state) {
+    size_t index = state.shared != nullptr ? state.shared->index_of(&child) : SIZE_MAX;
+    if (index == SIZE_MAX || n > CHROMA_SPAN_MAX) {
+        profiled_draw_span(child, indices, out, n, state);
+        return;
+    }
+
+    // Frames are numbered across every output, so a memo left by another output or frame never matches
+    thread_local std::vector<SpanMemo> memos;
+    if (memos.size() <= index)
+        memos.resize(index + 1);
+    SpanMemo& memo = memos[index];
+    if (memo.frame == state.frame && memo.time == state.time && memo.n == n && memcmp(memo.indices, indices, n * sizeof(float)) == 0) {
+        std::copy(memo.colors, memo.colors + n, out);
+        return;
+    }
+    profiled_draw_span(child, indices, out, n, state);
+    memo.frame = state.frame;
+    memo.time = state.time;
+    memo.n = n;
+    std::copy(indices, indices + n, memo.indices);
+    std::copy(out, out + n, memo.colors);
+}
@@ -0,0 +1,29 @@
+#ifndef CHROMA_MEMO_H
+#define CHROMA_MEMO_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chroma.hpp"
+#include "chromatic.hpp"
+
+// Effects reached more than once from an output's layers, like a variable used twice in a split or in two layers.
+// Found whenever a layer's effect is set, so unshared effects pay nothing per frame.
+// Each is ticked once per frame, and a span it drew is reused by the next parent drawing it at the same indices.
+class SharedEffects {
+    private:
+        std::vector<const ChromaEffect*> effects; // Sorted by address
+        mutable std::vector<uint64_t> ticked; // Frame each effect was last ticked on, only touched by the render thread
+    public:
+        SharedEffects(std::vector<const ChromaEffect*> effects);
+        // Null if no effect of the layers is reached twice
+        static std::shared_ptr<const SharedEffects> find(const LayerStack& layers);
+        size_t size() const { return this->effects.size(); }
+        // Position of a shared effect, SIZE_MAX if the effect is not shared
+        size_t index_of(const ChromaEffect* effect) const;
+        // Returns false if the effect is shared and was already ticked on the frame
+        bool claim_tick(const ChromaEffect* effect, uint64_t frame) const;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cmath>
+
+#include "frame_pacer.hpp"
+#include "metrics.hpp"
+
+const char* frame_stage_to_string(FrameStage stage) {
+    const char* names[] = {"tick", "draw", "composite", "packetize", "send", "sleep"};
+    return names[stage];
+}
+
+static size_t get_bucket(uint64_t ns) {
+    if (ns < (2 << HISTOGRAM_SUB_BITS))
+        return ns;
+    int shift = 63 - __builtin_clzll(ns) - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (ns >> shift) - (1 << HISTOGRAM_SUB_BITS);
+}
+
+static uint64_t get_bucket_max(size_t bucket) {
+    if (bucket < (2 << HISTOGRAM_SUB_BITS))
+        return bucket;
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = (bucket & ((1 << HISTOGRAM_SUB_BITS) - 1)) + (1 << HISTOGRAM_SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    ns = std::min<uint64_t>(ns, (1ULL << HISTOGRAM_MAX_BITS) - 1);
+    this->buckets[get_bucket(ns)]++;
+    this->count++;
+    this->max = std::max(this->max, ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        this->buckets[i] += other.buckets[i];
+    this->count += other.count;
+    this->max = std::max(this->max, other.max);
+}
+
+void LatencyHistogram::clear() {
+    std::fill(this->buckets.begin(), this->buckets.end(), 0);
+    this->count = 0;
+    this->max = 0;
+}
+
+uint64_t LatencyHistogram::quantile(double p) const {
+    if (this->count == 0)
+        return 0;
+    uint64_t rank = std::max<uint64_t>(std::ceil(p * this->count), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += this->buckets[i];
+        if (seen >= rank)
+            return std::min(get_bucket_max(i), this->max);
+    }
+    return this->max;
+}
+
+void FrameMetrics::rotate(int64_t now_ns) {
+    if (this->window_start == 0)
+        this->window_start = now_ns;
+    for (int i = 0; i < METRICS_WINDOWS && now_ns - this->window_start >= METRICS_WINDOW_NS; i++) {
+        this->current = (this->current + 1) % METRICS_WINDOWS;
+        for (auto& stage : this->windows)
+            stage[this->current].clear();
+        this->window_start += METRICS_WINDOW_NS;
+    }
+    if (now_ns - this->window_start >= METRICS_WINDOW_NS)
+        this->window_start = now_ns; // Every window was cleared, start over from now
+}
+
+void FrameMetrics::record(FrameStage stage, int64_t ns) {
+    ns = std::max(ns, (int64_t) 0);
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->rotate(get_monotonic_ns());
+    this->windows[stage][this->current].record(ns);
+    this->counts[stage]++;
+    this->sums_ns[stage] += ns;
+}
+
+StageSnapshot FrameMetrics::get_snapshot(FrameStage stage) {
+    StageSnapshot snapshot;
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->rotate(get_monotonic_ns());
+    for (auto& window : this->windows[stage])
+        snapshot.recent.merge(window);
+    snapshot.count = this->counts[stage];
+    snapshot.sum_ns = this->sums_ns[stage];
+    return snapshot;
+}
@@ -0,0 +1,66 @@
+#ifndef CHROMA_METRICS_H
+#define CHROMA_METRICS_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Log-linear buckets like HdrHistogram: exact below 64 ns, then 32 buckets per power of two (about 3% wide)
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_MAX_BITS 40 // Values are capped at 2^40 ns, about 18 minutes
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+// Quantiles cover the last METRICS_WINDOWS windows of METRICS_WINDOW_NS each, one minute in total
+#define METRICS_WINDOWS 6
+#define METRICS_WINDOW_NS 10000000000LL
+
+enum FrameStage {
+    STAGE_TICK,      // Ticking layers, checking their caches and compiling their programs
+    STAGE_DRAW,      // Drawing layers, summed over the render threads
+    STAGE_COMPOSITE, // Blending layers together, summed over the render threads
+    STAGE_PACKETIZE, // Quantizing frames to bytes, summed over the render threads
+    STAGE_SEND,      // The output callback, which builds and sends the Disco packets
+    STAGE_SLEEP,     // Waiting for the next frame, including idle time
+    NUM_FRAME_STAGES
+};
+
+const char* frame_stage_to_string(FrameStage stage);
+
+class LatencyHistogram {
+    private:
+        std::vector<uint32_t> buckets = std::vector<uint32_t>(HISTOGRAM_BUCKETS);
+        uint64_t count = 0;
+        uint64_t max = 0;
+    public:
+        void record(uint64_t ns);
+        void merge(const LatencyHistogram& other);
+        void clear();
+        uint64_t get_count() const { return this->count; }
+        uint64_t get_max() const { return this->max; }
+        // Highest value in the bucket holding the quantile, p from 0 to 1
+        uint64_t quantile(double p) const;
+};
+
+struct StageSnapshot {
+    LatencyHistogram recent; // Merged windows for quantiles
+    uint64_t count = 0;      // Every sample since the output started
+    double sum_ns = 0;
+};
+
+// Rolling per-stage latency histograms of one output, safe to record from any thread
+class FrameMetrics {
+    private:
+        LatencyHistogram windows[NUM_FRAME_STAGES][METRICS_WINDOWS];
+        uint64_t counts[NUM_FRAME_STAGES] = {0};
+        double sums_ns[NUM_FRAME_STAGES] = {0};
+        size_t current = 0;
+        int64_t window_start = 0;
+        std::mutex lock;
+
+        void rotate(int64_t now_ns);
+    public:
+        void record(FrameStage stage, int64_t ns);
+        StageSnapshot get_snapshot(FrameStage stage);
+};
+
+#endif
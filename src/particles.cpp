@@ -51,6 +51,11 @@ vec4 ParticleEffect::draw(float index, const ChromaState &state) const
     return this->effect->draw(index, state);
 }
 
+void ParticleEffect::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const
+{
+    this->effect->draw_span(indices, out, n, state);
+}
+
 // TODO: fix hiding effect.clone
 std::shared_ptr<ParticleEffect> ParticleEffect::clone(const PhysicsBody &body)
 {
@@ -59,7 +64,7 @@ std::shared_ptr<ParticleEffect> ParticleEffect::clone(const PhysicsBody &body)
     return output;
 }
 
-ParticleSystem::ParticleSystem(const std::vector<ChromaData> &args)
+ParticleSystem::ParticleSystem(const std::vector<ChromaData> &args) : ChromaEffect("psystem")
 {
     std::vector<ChromaData> list = args[0].get_list();
     for (auto& data : list) { //TODO: insert type check (somewhere)
@@ -120,26 +125,49 @@ void ParticleSystem::tick(const ChromaState &state)
         this->particles.erase(particle);
     }
 
+    float indices[CHROMA_SPAN_MAX];
+    vec4 colors[CHROMA_SPAN_MAX];
     for (auto& particle : this->particles) {
         //* NOTE: this can be parallelized
-        for (int i = floor(particle->get_lower_bound()); i <= floor(particle->get_upper_bound()) && i < state.pixel_length; i++) {
-            if (i >= 0) {
-                float index = (i - particle->get_lower_bound()) / (particle->get_upper_bound() - particle->get_lower_bound());
-                this->screen[i] += particle->draw(index, state); // TODO: alpha channels?
-            }
+        int first = std::max((int) floor(particle->get_lower_bound()), 0);
+        int last = std::min((int) floor(particle->get_upper_bound()), state.pixel_length - 1);
+        for (int start = first; start <= last; start += CHROMA_SPAN_MAX) {
+            int len = std::min(last - start + 1, CHROMA_SPAN_MAX);
+            for (int j = 0; j < len; j++)
+                indices[j] = (start + j - particle->get_lower_bound()) / (particle->get_upper_bound() - particle->get_lower_bound());
+            particle->draw_span(indices, colors, len, state);
+            for (int j = 0; j < len; j++)
+                this->screen[start + j] += colors[j]; // TODO: alpha channels?
         }
     }
 
     for (auto& new_particle : this->pending_particles) {
+        if (this->particles.size() >= state.quality.max_particles)
+            break;
         this->particles.insert(new_particle);
     }
     this->pending_particles.clear();
 }
 
+// Gaussian blur kernel for the quality's blur radius, renormalized when cut below MAX_BLUR_RADIUS
+static const float* get_blur_kernel(const ChromaState& state, int& radius, float* kernel) {
+    static const float full_kernel[] = {0.0002, 0.0060, 0.0606, 0.2417, 0.3829, 0.2417, 0.0606, 0.0060, 0.0002};
+    radius = std::clamp(state.quality.blur_radius, 0, MAX_BLUR_RADIUS);
+    if (radius == MAX_BLUR_RADIUS)
+        return full_kernel;
+    float sum = 0;
+    for (int i = -radius; i <= radius; i++)
+        sum += full_kernel[i + MAX_BLUR_RADIUS];
+    for (int i = -radius; i <= radius; i++)
+        kernel[i + radius] = full_kernel[i + MAX_BLUR_RADIUS] / sum;
+    return kernel;
+}
+
 vec4 ParticleSystem::draw(float index, const ChromaState &state) const
 {
-    const int gaussian_radius = 4;
-    float kernel[] = {0.0002, 0.0060, 0.0606, 0.2417, 0.3829, 0.2417, 0.0606, 0.0060, 0.0002};
+    int gaussian_radius;
+    float storage[2 * MAX_BLUR_RADIUS + 1];
+    const float* kernel = get_blur_kernel(state, gaussian_radius, storage);
     
     int position = floor(state.pixel_length * index);
     vec4 color(0, 0, 0, 0);
@@ -154,6 +182,23 @@ vec4 ParticleSystem::draw(float index, const ChromaState &state) const
     return color;
 }
 
+void ParticleSystem::draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const
+{
+    int gaussian_radius;
+    float storage[2 * MAX_BLUR_RADIUS + 1];
+    const float* kernel = get_blur_kernel(state, gaussian_radius, storage);
+
+    for (size_t k = 0; k < n; k++) {
+        int position = floor(state.pixel_length * indices[k]);
+        int lower = std::max(-gaussian_radius, -position);
+        int upper = std::min(gaussian_radius, state.pixel_length - 1 - position);
+        vec4 color(0, 0, 0, 0);
+        for (int i = lower; i <= upper; i++)
+            color += this->screen[position + i] * kernel[i + gaussian_radius];
+        out[k] = color;
+    }
+}
+
 void ParticleSystem::process_collisions(float delta_time) {
     // 1. Calculate bounding intervals
     std::vector<INTERVAL_POINT> interval_points = calculate_intervals(delta_time);
@@ -70,6 +70,7 @@ class ParticleEffect : public ChromaObject {
         bool is_in_bounds(float pos) const { return (this->body.position - this->radius) <= pos && pos <= (this->body.position + this->radius); }
         void tick(ParticleSystem& system, const ChromaState& state);
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
         std::shared_ptr<ParticleEffect> clone(const PhysicsBody& body);
         bool is_alive() { return this->alive; }
         void kill() { this->alive = false; }
@@ -87,6 +88,7 @@ class ParticleSystem : public ChromaEffect {
         ParticleSystem(const std::vector<ChromaData>& args);
         void tick(const ChromaState& state);
         vec4 draw(float index, const ChromaState& state) const;
+        void draw_span(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
         void add_particle(std::shared_ptr<ParticleEffect>& particle) { this->pending_particles.insert(particle); }
         //std::shared_ptr<ChromaObject> clone() const;
 };
@@ -104,7 +106,7 @@ class EmitterBehavior : public ParticleBehavior {
     private:
         std::shared_ptr<ParticleEffect> particle;
         float density;
-        float time_start;
+        double time_start;
         int particles_emitted;
         void emit(ParticleSystem& system, ParticleEffect& effect);
     public:
@@ -116,7 +118,7 @@ class EmitterBehavior : public ParticleBehavior {
 class LifetimeBehavior : public ParticleBehavior { 
     private:
         float lifetime;
-        float time_start;
+        double time_start;
     public:
         LifetimeBehavior(const std::vector<ChromaData>& args);
         void tick(ParticleSystem& system, ParticleEffect& particle, const ChromaState& state);
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "chroma.hpp"
+#include "frame_pacer.hpp"
+#include "memo.hpp"
+#include "profiler.hpp"
+
+struct TickScope {
+    std::string path;
+    int next_child = 0;
+    int64_t children_ns = 0;
+};
+
+struct TickProfile {
+    EffectProfiler* profiler;
+    size_t layer;
+    std::vector<TickScope> scopes;
+};
+
+// Set only while the render thread ticks a sampled frame
+thread_local TickProfile* tick_profile = nullptr;
+
+struct DrawScope {
+    const ChromaEffect* effect;
+    std::string path;
+    int next_child = 0;
+    int64_t children_ns = 0;
+};
+
+struct DrawProfile {
+    EffectProfiler* profiler;
+    size_t layer;
+    std::vector<DrawScope> scopes;
+};
+
+// Set only while a thread draws a span of a layer whose effect tree is profiled
+thread_local DrawProfile* draw_profile = nullptr;
+
+static void timed_tick(ChromaEffect& effect, const std::string& path, const ChromaState& state) {
+    tick_profile->scopes.push_back({path});
+    int64_t start = get_monotonic_ns();
+    effect.tick(state);
+    int64_t ns = get_monotonic_ns() - start;
+    int64_t children_ns = tick_profile->scopes.back().children_ns;
+    tick_profile->scopes.pop_back();
+    if (!tick_profile->scopes.empty())
+        tick_profile->scopes.back().children_ns += ns;
+    tick_profile->profiler->add_tick(tick_profile->layer, path, effect.get_typename(), ns - children_ns);
+}
+
+void ChromaEffect::tick_child(ChromaEffect& child, const ChromaState& state) {
+    if (state.shared != nullptr && !state.shared->claim_tick(&child, state.frame))
+        return;
+    if (tick_profile == nullptr) {
+        child.tick(state);
+        return;
+    }
+    TickScope& parent = tick_profile->scopes.back();
+    timed_tick(child, parent.path + "." + std::to_string(parent.next_child++), state);
+}
+
+void profile_tick(EffectProfiler& profiler, size_t layer, ChromaEffect& effect, const ChromaState& state) {
+    TickProfile profile = {&profiler, layer};
+    tick_profile = &profile;
+    timed_tick(effect, "0", state);
+    tick_profile = nullptr;
+}
+
+// Draws are named by the child's position among its parent's children, parents may draw a child more than once
+void profiled_draw_span(const ChromaEffect& child, const float* indices, vec4* out, size_t n, const ChromaState& state) {
+    if (draw_profile == nullptr) {
+        child.draw_span(indices, out, n, state);
+        return;
+    }
+    DrawScope& parent = draw_profile->scopes.back();
+    std::string path = "0";
+    if (parent.effect != nullptr) {
+        std::vector<const ChromaEffect*> children = parent.effect->get_children();
+        auto it = std::find(children.begin(), children.end(), &child);
+        path = parent.path + "." + std::to_string(it != children.end() ? it - children.begin() : parent.next_child);
+        parent.next_child++;
+    }
+
+    draw_profile->scopes.push_back({&child, path});
+    int64_t start = get_monotonic_ns();
+    child.draw_span(indices, out, n, state);
+    int64_t ns = get_monotonic_ns() - start;
+    int64_t children_ns = draw_profile->scopes.back().children_ns;
+    draw_profile->scopes.pop_back();
+    draw_profile->scopes.back().children_ns += ns;
+    draw_profile->profiler->add_draw(draw_profile->layer, path, child.get_typename(), ns - children_ns);
+}
+
+void profile_draw(EffectProfiler& profiler, size_t layer, const ChromaEffect& effect, const float* indices, vec4* out, size_t n,
+    const ChromaState& state) {
+    DrawProfile profile = {&profiler, layer};
+    profile.scopes.push_back({nullptr, ""});
+    draw_profile = &profile;
+    ChromaEffect::draw_child(effect, indices, out, n, state);
+    draw_profile = nullptr;
+}
+
+bool EffectProfiler::sample() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->countdown > 0) {
+        this->countdown--;
+        return false;
+    }
+    this->countdown = PROFILE_INTERVAL - 1;
+    return true;
+}
+
+ProfileEntry& EffectProfiler::get_entry(size_t layer, const std::string& path, const std::string& type) {
+    ProfileEntry& entry = this->entries[std::make_tuple(layer, path, type)];
+    entry.layer = layer;
+    entry.path = path;
+    entry.type = type;
+    return entry;
+}
+
+void EffectProfiler::add_tick(size_t layer, const std::string& path, const std::string& type, int64_t ns) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->get_entry(layer, path, type).tick_ns += ns;
+}
+
+void EffectProfiler::add_draw(size_t layer, const std::string& path, const std::string& type, int64_t ns) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->get_entry(layer, path, type).draw_ns += ns;
+}
+
+void EffectProfiler::end_frame() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->frames++;
+}
+
+void EffectProfiler::clear() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->entries.clear();
+    this->frames = 0;
+    this->countdown = 0;
+}
+
+std::vector<ProfileEntry> EffectProfiler::get_entries(uint64_t& frames) {
+    std::vector<ProfileEntry> entries;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        frames = this->frames;
+        for (auto& entry : this->entries)
+            entries.push_back(entry.second);
+    }
+    std::sort(entries.begin(), entries.end(), [](const ProfileEntry& a, const ProfileEntry& b){
+        return a.tick_ns + a.draw_ns > b.tick_ns + b.draw_ns;
+    });
+    return entries;
+}
+
+std::string EffectProfiler::to_string() {
+    uint64_t frames;
+    std::vector<ProfileEntry> entries = this->get_entries(frames);
+    if (frames == 0)
+        return "no frames sampled\n";
+
+    double total_ns = 0;
+    for (auto& entry : entries)
+        total_ns += entry.tick_ns + entry.draw_ns;
+    std::string result = std::to_string(frames) + " frames sampled, mean per frame:\n";
+    char line[256];
+    for (auto& entry : entries) {
+        snprintf(line, sizeof(line), "  layer %zu %-12s %-16s tick %9.2f us  draw %9.2f us  %5.1f%%\n",
+            entry.layer, entry.path.c_str(), entry.type.c_str(), entry.tick_ns / frames / 1e3, entry.draw_ns / frames / 1e3,
+            total_ns > 0 ? (entry.tick_ns + entry.draw_ns) / total_ns * 100 : 0);
+        result += line;
+    }
+    return result;
+}
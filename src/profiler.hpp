@@ -0,0 +1,58 @@
+#ifndef CHROMA_PROFILER_H
+#define CHROMA_PROFILER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Profiled outputs time one frame in PROFILE_INTERVAL, the timers cost a few percent of that frame
+#define PROFILE_INTERVAL 32
+
+class ChromaEffect;
+struct ChromaState;
+struct vec4;
+
+// Times of one node of a layer's effect tree, excluding its children, summed over the sampled frames.
+// Path is the node's position in the tree, "0" for the layer's effect and "0.1" for its second child.
+struct ProfileEntry {
+    size_t layer;
+    std::string path;
+    std::string type;
+    double tick_ns = 0;
+    double draw_ns = 0; // Summed over the render threads
+};
+
+// Per-node tick and draw times of one output, sampled every PROFILE_INTERVAL frames
+class EffectProfiler {
+    private:
+        std::map<std::tuple<size_t, std::string, std::string>, ProfileEntry> entries;
+        uint64_t frames = 0;
+        uint64_t countdown = 0;
+        std::mutex lock;
+
+        ProfileEntry& get_entry(size_t layer, const std::string& path, const std::string& type);
+    public:
+        // Called by the render thread once per frame, returns true if the frame should be profiled
+        bool sample();
+        void add_tick(size_t layer, const std::string& path, const std::string& type, int64_t ns);
+        void add_draw(size_t layer, const std::string& path, const std::string& type, int64_t ns);
+        void end_frame();
+        void clear();
+        // Entries from the most to the least expensive, along with the number of sampled frames
+        std::vector<ProfileEntry> get_entries(uint64_t& frames);
+        std::string to_string();
+};
+
+// Ticks a layer's effect, timing it and every child ticked through ChromaEffect::tick_child
+void profile_tick(EffectProfiler& profiler, size_t layer, ChromaEffect& effect, const ChromaState& state);
+// Draws a span of a layer's effect tree, timing it and every child drawn through ChromaEffect::draw_child.
+// Children drawn a pixel at a time through draw count towards their parent.
+void profile_draw(EffectProfiler& profiler, size_t layer, const ChromaEffect& effect, const float* indices, vec4* out, size_t n,
+    const ChromaState& state);
+// Calls child.draw_span, timing it while the calling thread is inside profile_draw
+void profiled_draw_span(const ChromaEffect& child, const float* indices, vec4* out, size_t n, const ChromaState& state);
+
+#endif
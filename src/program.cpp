@@ -0,0 +1,327 @@
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include <cmath>
+#include <math.h>
+
+#include "frame_pacer.hpp"
+#include "kernels.hpp"
+#include "memo.hpp"
+#include "profiler.hpp"
+#include "program.hpp"
+
+// Same result as fmod(x, 1) including the sign of zero, without the libm call
+static inline float remainder_one(float x) {
+    return std::copysign(x - std::trunc(x), x);
+}
+
+void ChromaEffect::compile(ChromaProgram& program, uint16_t indices, uint16_t out, const ChromaState& state) const {
+    program.emit_call(this, indices, out);
+}
+
+void ChromaProgram::emit_call(const ChromaEffect* effect, uint16_t indices, uint16_t out) {
+    ChromaOp op;
+    op.code = OP_CALL;
+    op.dst = out;
+    op.src = indices;
+    op.effect = effect;
+    this->emit(op);
+}
+
+void ChromaProgram::emit_fill(vec4 color, uint16_t out) {
+    ChromaOp op;
+    op.code = OP_FILL;
+    op.dst = out;
+    op.color = color;
+    this->emit(op);
+}
+
+void ChromaProgram::emit_scale(float factor, uint16_t out) {
+    ChromaOp op;
+    op.code = OP_SCALE;
+    op.dst = out;
+    op.a = factor;
+    this->emit(op);
+}
+
+void ChromaProgram::compile(const ChromaEffect& effect, const ChromaState& state) {
+    this->ops.clear();
+    this->tree_profiler = nullptr;
+    this->constants.clear();
+    this->num_indices = 1;
+    this->num_colors = 1;
+    this->gather_depth = 0;
+    this->max_gather_depth = 0;
+    this->nodes.assign(1, {&effect, -1, 0, 0});
+    this->current_node = 0;
+    this->compile_node(effect, 0, 0, state);
+    this->optimize();
+}
+
+void ChromaProgram::compile_node(const ChromaEffect& effect, uint16_t indices, uint16_t out, const ChromaState& state) {
+    // A shared effect is drawn once for every parent sampling it at the same indices instead of being inlined
+    if (state.shared != nullptr && state.shared->index_of(&effect) != SIZE_MAX) {
+        ChromaOp op;
+        op.code = OP_SHARED;
+        op.dst = out;
+        op.src = indices;
+        op.effect = &effect;
+        this->emit(op);
+        return;
+    }
+    effect.compile(*this, indices, out, state);
+}
+
+void ChromaProgram::compile_child(const ChromaEffect& child, uint16_t indices, uint16_t out, const ChromaState& state) {
+    uint16_t parent = this->current_node;
+    this->nodes.push_back({&child, parent, this->nodes[parent].num_children++, 0});
+    this->current_node = this->nodes.size() - 1;
+    this->compile_node(child, indices, out, state);
+    this->current_node = parent;
+}
+
+std::string ChromaProgram::get_node_path(size_t node) const {
+    const ChromaNode& n = this->nodes[node];
+    if (n.parent < 0)
+        return "0";
+    return this->get_node_path(n.parent) + "." + std::to_string(n.child);
+}
+
+void ChromaProgram::set_profiling(bool enabled) {
+    if (!enabled) {
+        this->op_times = nullptr;
+        return;
+    }
+    this->op_times.reset(new std::atomic<int64_t>[this->ops.size()]);
+    for (size_t i = 0; i < this->ops.size(); i++)
+        this->op_times[i] = 0;
+}
+
+void ChromaProgram::add_draw_times(EffectProfiler& profiler, size_t layer) const {
+    if (this->op_times == nullptr)
+        return;
+    std::vector<int64_t> node_times(this->nodes.size());
+    for (size_t i = 0; i < this->ops.size(); i++)
+        node_times[this->ops[i].node] += this->op_times[i];
+    for (size_t node = 0; node < this->nodes.size(); node++)
+        profiler.add_draw(layer, this->get_node_path(node), this->nodes[node].effect->get_typename(), node_times[node]);
+}
+
+void ChromaProgram::optimize() {
+    // Count the reads of every index register, then drop transforms with no readers from the back,
+    // which may leave the transforms feeding them unread as well
+    thread_local std::vector<int> reads;
+    thread_local std::vector<bool> removed;
+    thread_local std::vector<size_t> positions;
+    thread_local std::vector<ChromaOp> optimized;
+    reads.assign(this->num_indices, 0);
+    for (auto& op : this->ops) {
+        switch (op.code) {
+            case OP_FILL: case OP_SCALE: break;
+            case OP_GATHER: reads[op.src]++; reads[op.aux]++; break;
+            case OP_SCATTER: reads[op.positions]++; break;
+            default: reads[op.src]++; break;
+        }
+    }
+    removed.assign(this->ops.size(), false);
+    for (size_t i = this->ops.size(); i-- > 0;) {
+        const ChromaOp& op = this->ops[i];
+        if ((op.code == OP_SLIDE || op.code == OP_WAVE) && reads[op.dst] == 0) {
+            removed[i] = true;
+            reads[op.src]--;
+        }
+    }
+
+    optimized.clear();
+    positions.resize(this->ops.size());
+    for (size_t i = 0; i < this->ops.size(); i++) {
+        const ChromaOp& op = this->ops[i];
+        positions[i] = optimized.size();
+        if (removed[i])
+            continue;
+
+        ChromaOp* last = optimized.empty() ? nullptr : &optimized.back();
+        if (op.code == OP_SCALE) {
+            if (op.a == 1)
+                continue;
+            if (last != nullptr && last->dst == op.dst) {
+                if (last->code == OP_SCALE) {
+                    last->a *= op.a;
+                    continue;
+                }
+                if (last->code == OP_FILL) {
+                    last->color = last->color * op.a;
+                    continue;
+                }
+                if (last->code == OP_RAINBOW || last->code == OP_GRADIENT) {
+                    last->scale *= op.a;
+                    continue;
+                }
+            }
+        }
+        optimized.push_back(op);
+    }
+
+    for (auto& op : optimized) {
+        if (op.code == OP_GATHER)
+            op.jump = positions[op.jump]; // Scatters are never removed
+    }
+    this->ops.swap(optimized);
+}
+
+void ChromaProgram::run(const float* input, vec4* out, size_t length, const ChromaState& state) const {
+    thread_local std::vector<float> index_storage;
+    thread_local std::vector<vec4> color_storage;
+    thread_local std::vector<float*> indices;
+    thread_local std::vector<vec4*> colors;
+    thread_local std::vector<size_t> spans;
+
+    index_storage.resize(this->num_indices * CHROMA_SPAN_MAX);
+    color_storage.resize(this->num_colors * CHROMA_SPAN_MAX);
+    indices.resize(this->num_indices);
+    colors.resize(this->num_colors);
+    spans.resize(this->max_gather_depth);
+    for (size_t r = 1; r < this->num_indices; r++)
+        indices[r] = index_storage.data() + r * CHROMA_SPAN_MAX;
+    for (size_t r = 1; r < this->num_colors; r++)
+        colors[r] = color_storage.data() + r * CHROMA_SPAN_MAX;
+
+    const SimdKernels& kernels = get_kernels();
+    std::atomic<int64_t>* op_times = this->op_times.get();
+    for (size_t offset = 0; offset < length; offset += CHROMA_SPAN_MAX) {
+        size_t n = std::min(length - offset, (size_t) CHROMA_SPAN_MAX);
+        indices[0] = const_cast<float*>(input + offset); // Never written, every op writing indices gets a new register
+        colors[0] = out + offset;
+        int depth = 0;
+        int64_t op_start = 0;
+        size_t timed_op = SIZE_MAX;
+
+        for (size_t pc = 0; pc < this->ops.size(); pc++) {
+            const ChromaOp& op = this->ops[pc];
+            if (op_times != nullptr) {
+                // Charges the time since the last op started to it, one clock read per op
+                int64_t now = get_monotonic_ns();
+                if (timed_op != SIZE_MAX)
+                    op_times[timed_op].fetch_add(now - op_start, std::memory_order_relaxed);
+                op_start = now;
+                timed_op = pc;
+            }
+            switch (op.code) {
+                case OP_CALL:
+                    op.effect->draw_span(indices[op.src], colors[op.dst], n, state);
+                    break;
+                case OP_SHARED:
+                    ChromaEffect::draw_child(*op.effect, indices[op.src], colors[op.dst], n, state);
+                    break;
+                case OP_FILL:
+                    std::fill(colors[op.dst], colors[op.dst] + n, op.color);
+                    break;
+                case OP_RAINBOW: {
+                    const float* in = indices[op.src];
+                    vec4* dst = colors[op.dst];
+                    for (size_t j = 0; j < n; j++) {
+                        float i = in[j] * 3;
+                        dst[j] = vec4(std::fmod(i + 1, 3), i, std::fmod(i - 1, 3), 1);
+                    }
+                    kernels.tent(&dst->x, &dst->x, n * 4);
+                    if (op.scale != 1)
+                        kernels.scale(&dst->x, &dst->x, op.scale, n * 4);
+                    break;
+                }
+                case OP_GRADIENT: {
+                    const float* in = indices[op.src];
+                    const vec4* stops = this->constants.data() + op.constant;
+                    vec4* dst = colors[op.dst];
+                    for (size_t j = 0; j < n; j++) {
+                        float index = in[j];
+                        if (index == 1) {
+                            dst[j] = op.color * op.scale;
+                            continue;
+                        }
+                        index = index * (op.count - 1);
+                        int i = floor(index);
+                        float lerp = index - i;
+                        dst[j] = (stops[i] * (1 - lerp) + stops[i + 1] * lerp) * op.scale;
+                    }
+                    break;
+                }
+                case OP_SCALE:
+                    kernels.scale(&colors[op.dst]->x, &colors[op.dst]->x, op.a, n * 4);
+                    break;
+                case OP_CUTOFF: {
+                    const float* in = indices[op.src];
+                    vec4* dst = colors[op.dst];
+                    for (size_t j = 0; j < n; j++) {
+                        if (in[j] > op.a)
+                            dst[j] = vec4(0, 0, 0, 0);
+                    }
+                    break;
+                }
+                case OP_SLIDE: {
+                    const float* in = indices[op.src];
+                    float* dst = indices[op.dst];
+                    for (size_t j = 0; j < n; j++)
+                        dst[j] = remainder_one(1 + in[j] - op.a);
+                    break;
+                }
+                case OP_WAVE: {
+                    const float* in = indices[op.src];
+                    float* dst = indices[op.dst];
+                    for (size_t j = 0; j < n; j++) {
+                        float phase = (in[j] * op.a / op.b - op.c) * 2 * M_PI;
+                        dst[j] = (1 + sin(phase)) / 2;
+                    }
+                    break;
+                }
+                case OP_SPLIT: {
+                    const float* in = indices[op.src];
+                    float* local = indices[op.dst];
+                    float* sections = indices[op.aux];
+                    for (size_t j = 0; j < n; j++) {
+                        float index = in[j];
+                        if (index != 1)
+                            index = index * op.count;
+                        else
+                            index = op.count - 1;
+                        sections[j] = static_cast<int>(floor(index));
+                        local[j] = remainder_one(index);
+                    }
+                    break;
+                }
+                case OP_GATHER: {
+                    const float* in = indices[op.src];
+                    const float* sections = indices[op.aux];
+                    float* gathered = indices[op.dst];
+                    float* positions = indices[op.positions];
+                    size_t count = 0;
+                    for (size_t j = 0; j < n; j++) {
+                        if (sections[j] == op.a) {
+                            gathered[count] = in[j];
+                            positions[count] = j;
+                            count++;
+                        }
+                    }
+                    if (count == 0) {
+                        pc = op.jump;
+                        break;
+                    }
+                    spans[depth++] = n;
+                    n = count;
+                    break;
+                }
+                case OP_SCATTER: {
+                    const vec4* src = colors[op.src];
+                    const float* positions = indices[op.positions];
+                    vec4* dst = colors[op.dst];
+                    for (size_t j = 0; j < n; j++)
+                        dst[static_cast<size_t>(positions[j])] = src[j];
+                    n = spans[--depth];
+                    break;
+                }
+            }
+        }
+        if (timed_op != SIZE_MAX)
+            op_times[timed_op].fetch_add(get_monotonic_ns() - op_start, std::memory_order_relaxed);
+    }
+}
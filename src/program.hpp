@@ -0,0 +1,129 @@
+#ifndef CHROMA_PROGRAM_H
+#define CHROMA_PROGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chroma.hpp"
+#include "chromatic.hpp"
+
+// Index registers hold one float per pixel of the span, color registers one vec4.
+// Register 0 of each is the program's input indices and output pixels.
+enum ChromaOpCode {
+    OP_CALL,     // colors[dst] = effect->draw_span(indices[src])
+    OP_SHARED,   // colors[dst] = effect drawn at indices[src] through ChromaEffect::draw_child, for effects with several parents
+    OP_FILL,     // colors[dst] = color
+    OP_RAINBOW,  // colors[dst] = rainbow(indices[src]) * scale
+    OP_GRADIENT, // colors[dst] = lerp of constants[constant, constant + count) at indices[src], color at index 1, times scale
+    OP_SCALE,    // colors[dst] *= a
+    OP_CUTOFF,   // colors[dst] = 0 where indices[src] > a
+    OP_SLIDE,    // indices[dst] = fmod(1 + indices[src] - a, 1)
+    OP_WAVE,     // indices[dst] = (1 + sin((indices[src] * a / b - c) * 2pi)) / 2
+    OP_SPLIT,    // indices[dst] = local index, indices[aux] = section of indices[src] split count ways
+    OP_GATHER,   // Packs indices[src] of the pixels in section a of indices[aux] into indices[dst], their positions into
+                 // indices[positions], then narrows the span to them or jumps past the matching OP_SCATTER if there are none
+    OP_SCATTER   // colors[dst] at indices[positions] = colors[src], then restores the span from before the OP_GATHER
+};
+
+struct ChromaOp {
+    ChromaOpCode code;
+    uint16_t dst = 0;
+    uint16_t src = 0;
+    uint16_t aux = 0;
+    uint16_t positions = 0;
+    float a = 0;
+    float b = 0;
+    float c = 0;
+    float scale = 1;
+    size_t count = 0;
+    size_t constant = 0;
+    size_t jump = 0;
+    vec4 color;
+    const ChromaEffect* effect = nullptr;
+    uint16_t node = 0; // Effect that emitted the op, set by emit
+};
+
+// An effect of the compiled tree, child is its position among its parent's children
+struct ChromaNode {
+    const ChromaEffect* effect;
+    int parent;
+    int child;
+    int num_children;
+};
+
+class EffectProfiler;
+
+// A layer's effect tree flattened into a linear list of span operations with their parameters inlined.
+// Compiled after every tick, since parameters like fades and offsets change from frame to frame.
+class ChromaProgram {
+    private:
+        std::vector<ChromaOp> ops;
+        std::vector<vec4> constants;
+        uint16_t num_indices = 1;
+        uint16_t num_colors = 1;
+        int gather_depth = 0;
+        int max_gather_depth = 0;
+        std::vector<ChromaNode> nodes;
+        uint16_t current_node = 0;
+        std::unique_ptr<std::atomic<int64_t>[]> op_times; // Time spent in each op while profiling
+        EffectProfiler* tree_profiler = nullptr; // Times the effect tree of an empty program while set
+        size_t tree_layer = 0;
+
+        void compile_node(const ChromaEffect& effect, uint16_t indices, uint16_t out, const ChromaState& state);
+    public:
+        // Compiles and optimizes the effect's ops for the current frame
+        void compile(const ChromaEffect& effect, const ChromaState& state);
+        // Drops the ops, an empty program is drawn through the effect tree instead
+        void clear() { this->ops.clear(); this->tree_profiler = nullptr; }
+        // Drops index transforms nobody reads and folds color scales into the op before them.
+        // Fused scales are multiplied together first, so results can differ in the last bit. Chained
+        // slides are left apart, each one wraps at its own seam.
+        void optimize();
+        // Draws n pixels like effect.draw_span would, state must be the state the program was compiled with
+        void run(const float* indices, vec4* out, size_t n, const ChromaState& state) const;
+
+        uint16_t add_indices() { return this->num_indices++; }
+        uint16_t add_colors() { return this->num_colors++; }
+        size_t add_constants(const std::vector<vec4>& colors) {
+            this->constants.insert(this->constants.end(), colors.begin(), colors.end());
+            return this->constants.size() - colors.size();
+        }
+        size_t emit(const ChromaOp& op) {
+            this->ops.push_back(op);
+            this->ops.back().node = this->current_node;
+            return this->ops.size() - 1;
+        }
+        ChromaOp& at(size_t position) { return this->ops[position]; }
+        size_t size() const { return this->ops.size(); }
+
+        // Compiles a child effect, effects compile their children through this so ops know which node they came from
+        void compile_child(const ChromaEffect& child, uint16_t indices, uint16_t out, const ChromaState& state);
+        // Position of the node in the tree, like "0.1" for the second child of the root
+        std::string get_node_path(size_t node) const;
+
+        // While profiling, run() times every op. Should only be toggled between frames.
+        void set_profiling(bool enabled);
+        bool is_profiling() const { return this->op_times != nullptr; }
+        // Has draw_effect time the effect tree of an empty program into profiler, null to stop
+        void set_tree_profiling(EffectProfiler* profiler, size_t layer) {
+            this->tree_profiler = profiler;
+            this->tree_layer = layer;
+        }
+        EffectProfiler* get_tree_profiler() const { return this->tree_profiler; }
+        size_t get_tree_layer() const { return this->tree_layer; }
+        // Adds the time spent in each node's ops to the profiler
+        void add_draw_times(EffectProfiler& profiler, size_t layer) const;
+
+        // Shorthands for the ops most effects compile to
+        void emit_call(const ChromaEffect* effect, uint16_t indices, uint16_t out);
+        void emit_fill(vec4 color, uint16_t out);
+        void emit_scale(float factor, uint16_t out);
+        // Marks a gather/scatter pair so run() knows how deep they nest
+        void begin_gather() { this->max_gather_depth = std::max(this->max_gather_depth, ++this->gather_depth); }
+        void end_gather() { this->gather_depth--; }
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include <algorithm>
+
+#include "render_pool.hpp"
+
+bool RenderPool::WorkQueue::pop_front(size_t& chunk) {
+    uint64_t current = this->range.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t begin = current >> 32;
+        uint64_t end = current & 0xffffffff;
+        if (begin >= end)
+            return false;
+        if (this->range.compare_exchange_weak(current, ((begin + 1) << 32) | end, std::memory_order_acq_rel)) {
+            chunk = begin;
+            return true;
+        }
+    }
+}
+
+bool RenderPool::WorkQueue::pop_back(size_t& chunk) {
+    uint64_t current = this->range.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t begin = current >> 32;
+        uint64_t end = current & 0xffffffff;
+        if (begin >= end)
+            return false;
+        if (this->range.compare_exchange_weak(current, (begin << 32) | (end - 1), std::memory_order_acq_rel)) {
+            chunk = end - 1;
+            return true;
+        }
+    }
+}
+
+RenderPool::RenderPool(size_t num_threads) {
+    if (num_threads == 0)
+        num_threads = 1;
+    for (size_t i = 0; i + 1 < num_threads; i++) {
+        this->workers.emplace_back([this](){ this->run_worker(); });
+    }
+}
+
+RenderPool::~RenderPool() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->job_available.notify_all();
+    for (auto& worker : this->workers) {
+        worker.join();
+    }
+}
+
+void RenderPool::run_worker() {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (true) {
+        this->job_available.wait(guard, [this](){ return this->stopping || !this->jobs.empty(); });
+        if (this->stopping)
+            return;
+
+        // Rotate the job list so concurrent jobs share the workers
+        RenderJob* job = this->jobs.front();
+        this->jobs.splice(this->jobs.end(), this->jobs, this->jobs.begin());
+        job->active++;
+        guard.unlock();
+
+        this->work_on(*job, job->next_queue.fetch_add(1) % job->queues.size());
+
+        guard.lock();
+        job->active--;
+        this->retire(*job);
+    }
+}
+
+void RenderPool::work_on(RenderJob& job, size_t queue) {
+    size_t n = job.queues.size();
+    size_t chunk;
+    for (size_t i = 0; i < n; i++) {
+        WorkQueue& victim = job.queues[(queue + i) % n];
+        while (i == 0 ? victim.pop_front(chunk) : victim.pop_back(chunk)) {
+            size_t start = chunk * job.chunk_size;
+            (*job.fn)(start, std::min(start + job.chunk_size, job.length));
+            if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> guard(this->lock);
+                job.done = true;
+                this->job_finished.notify_all();
+            }
+        }
+    }
+}
+
+// Must hold the lock, every chunk of the job has been claimed so stop handing it to workers
+void RenderPool::retire(RenderJob& job) {
+    this->jobs.remove(&job);
+    if (job.active == 0 && job.done)
+        this->job_finished.notify_all();
+}
+
+void RenderPool::parallel_for(size_t length, size_t chunk_size, const std::function<void(size_t, size_t)>& fn) {
+    if (length == 0)
+        return;
+    if (chunk_size == 0)
+        chunk_size = length;
+
+    size_t num_chunks = (length + chunk_size - 1) / chunk_size;
+    if (num_chunks == 1 || this->workers.empty()) {
+        for (size_t start = 0; start < length; start += chunk_size)
+            fn(start, std::min(start + chunk_size, length));
+        return;
+    }
+
+    size_t num_queues = std::min(num_chunks, this->get_num_threads());
+    RenderJob job(num_queues);
+    job.fn = &fn;
+    job.length = length;
+    job.chunk_size = chunk_size;
+    job.remaining = num_chunks;
+    for (size_t i = 0; i < num_queues; i++) {
+        uint64_t begin = num_chunks * i / num_queues;
+        uint64_t end = num_chunks * (i + 1) / num_queues;
+        job.queues[i].range = (begin << 32) | end;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->jobs.push_back(&job);
+    }
+    this->job_available.notify_all();
+
+    this->work_on(job, job.next_queue.fetch_add(1) % num_queues);
+
+    // Single barrier per job: wait for the last chunk and for every worker to let go of the job
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->jobs.remove(&job);
+    this->job_finished.wait(guard, [&job](){ return job.done && job.active == 0; });
+}
@@ -0,0 +1,67 @@
+#ifndef CHROMA_RENDER_POOL_H
+#define CHROMA_RENDER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define CACHE_LINE_SIZE 64
+
+// Long-lived worker pool that splits a range into chunks and balances them by work stealing.
+// The calling thread takes part in its own job, so a pool of N threads spawns N - 1 workers.
+class RenderPool {
+    private:
+        // Chunk range [begin, end) packed into one word so the owner can pop from
+        // the front and thieves can steal from the back without a lock
+        struct alignas(CACHE_LINE_SIZE) WorkQueue {
+            std::atomic<uint64_t> range;
+            WorkQueue() : range(0) { }
+            bool pop_front(size_t& chunk);
+            bool pop_back(size_t& chunk);
+        };
+
+        struct RenderJob {
+            const std::function<void(size_t, size_t)>* fn;
+            size_t length;
+            size_t chunk_size;
+            std::vector<WorkQueue> queues;
+            std::atomic<size_t> remaining;
+            std::atomic<size_t> next_queue;
+            int active = 0;
+            bool done = false;
+            RenderJob(size_t num_queues) : queues(num_queues), remaining(0), next_queue(0) { }
+        };
+
+        std::vector<std::thread> workers;
+        std::list<RenderJob*> jobs;
+        std::mutex lock;
+        std::condition_variable job_available;
+        std::condition_variable job_finished;
+        bool stopping = false;
+
+        void run_worker();
+        void work_on(RenderJob& job, size_t queue);
+        void retire(RenderJob& job);
+    public:
+        RenderPool(size_t num_threads = std::thread::hardware_concurrency());
+        ~RenderPool();
+        RenderPool(const RenderPool&) = delete;
+        RenderPool& operator=(const RenderPool&) = delete;
+        size_t get_num_threads() const { return this->workers.size() + 1; }
+        // Calls fn(i, worker) for every worker thread, for settings such as scheduling applied from outside
+        void for_each_worker(const std::function<void(size_t, std::thread&)>& fn) {
+            for (size_t i = 0; i < this->workers.size(); i++)
+                fn(i, this->workers[i]);
+        }
+        // Calls fn(start, end) over [0, length) in chunks that are a multiple of a cache line,
+        // returning once every chunk is done. Safe to call from several threads at once.
+        void parallel_for(size_t length, size_t chunk_size, const std::function<void(size_t, size_t)>& fn);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef CHROMA_SNAPSHOT_H
+#define CHROMA_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#define SNAPSHOT_IDLE UINT64_MAX
+
+// Immutable value read by exactly one thread while others publish replacements.
+// The reader never blocks or frees memory: replaced values are retired with the epoch they were
+// replaced in and deleted by a later writer once the reader has announced a newer epoch.
+// Writers must be serialized by the caller.
+template <class T>
+class EpochSnapshot {
+    private:
+        std::atomic<const T*> current;
+        std::atomic<uint64_t> epoch;
+        std::atomic<uint64_t> reader_epoch; // Epoch the reader entered at, SNAPSHOT_IDLE between reads
+        std::vector<std::pair<uint64_t, const T*>> retired; // Owned by the writers
+    public:
+        EpochSnapshot(const T* initial) : current(initial), epoch(1), reader_epoch(SNAPSHOT_IDLE) { }
+        EpochSnapshot(const EpochSnapshot&) = delete;
+        EpochSnapshot& operator=(const EpochSnapshot&) = delete;
+        ~EpochSnapshot();
+
+        // Reader side, the returned value stays alive until exit()
+        const T* enter();
+        void exit() { this->reader_epoch.store(SNAPSHOT_IDLE); }
+
+        // Writer side, get() is only safe to call from a writer
+        const T* get() const { return this->current.load(); }
+        void publish(const T* value);
+        // Deletes every retired value the reader can no longer see
+        void reclaim();
+};
+
+template <class T>
+EpochSnapshot<T>::~EpochSnapshot() {
+    delete this->current.load();
+    for (auto& entry : this->retired)
+        delete entry.second;
+}
+
+template <class T>
+const T* EpochSnapshot<T>::enter() {
+    // Announce before loading, so a writer that sees the announcement knows which values may be in use
+    this->reader_epoch.store(this->epoch.load());
+    return this->current.load();
+}
+
+template <class T>
+void EpochSnapshot<T>::publish(const T* value) {
+    const T* old = this->current.exchange(value);
+    // A reader entering at the new epoch or later loads value, never old
+    this->retired.push_back({++this->epoch, old});
+    this->reclaim();
+}
+
+template <class T>
+void EpochSnapshot<T>::reclaim() {
+    uint64_t reading = this->reader_epoch.load();
+    size_t kept = 0;
+    for (auto& entry : this->retired) {
+        if (reading != SNAPSHOT_IDLE && reading < entry.first)
+            this->retired[kept++] = entry;
+        else
+            delete entry.second;
+    }
+    this->retired.resize(kept);
+}
+
+#endif
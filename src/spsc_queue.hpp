@@ -0,0 +1,44 @@
+#ifndef CHROMA_SPSC_QUEUE_H
+#define CHROMA_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+#include "render_pool.hpp"
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread
+template <class T, size_t N>
+class SPSCQueue {
+    private:
+        T items[N + 1];
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> head; // Next item to pop, owned by the consumer
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail; // Next slot to push, owned by the producer
+    public:
+        SPSCQueue() : head(0), tail(0) { }
+        bool push(const T& item);
+        bool pop(T& item);
+        bool empty() const { return this->head.load(std::memory_order_acquire) == this->tail.load(std::memory_order_acquire); }
+};
+
+template <class T, size_t N>
+bool SPSCQueue<T, N>::push(const T& item) {
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    size_t next = (tail + 1) % (N + 1);
+    if (next == this->head.load(std::memory_order_acquire))
+        return false;
+    this->items[tail] = item;
+    this->tail.store(next, std::memory_order_release);
+    return true;
+}
+
+template <class T, size_t N>
+bool SPSCQueue<T, N>::pop(T& item) {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    if (head == this->tail.load(std::memory_order_acquire))
+        return false;
+    item = this->items[head];
+    this->head.store((head + 1) % (N + 1), std::memory_order_release);
+    return true;
+}
+
+#endif
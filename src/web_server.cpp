@@ -20,12 +20,30 @@ void ChromaWebServer::add_POST_route(ChromaHTTPResource& resource) {
     this->ws.register_resource(this->base_path + resource.get_path(), &resource);
 }
 
+void ChromaWebServer::add_GET_route(ChromaHTTPResource& resource) {
+    resource.disallow_all();
+    resource.set_allowing("GET", true);
+    this->ws.register_resource(this->base_path + resource.get_path(), &resource);
+}
+
 void ChromaWebServer::start() {
     fprintf(stderr, "Starting HTTP server\n");
 
     this->add_POST_route(this->chroma_config_rsc);
     this->add_POST_route(this->disco_config_rsc);
     this->add_POST_route(this->chroma_script_rsc);
+    this->add_GET_route(this->metrics_rsc);
+    this->add_GET_route(this->profile_rsc);
+
+    this->ws.start(false);
+    fprintf(stderr, "HTTP server started\n");
+}
+
+void ChromaWebServer::start_read_only() {
+    fprintf(stderr, "Starting read-only HTTP server\n");
+
+    this->add_GET_route(this->metrics_rsc);
+    this->add_GET_route(this->profile_rsc);
 
     this->ws.start(false);
     fprintf(stderr, "HTTP server started\n");
@@ -42,10 +60,15 @@ std::shared_ptr<httpserver::http_response> ChromaWebServer::PostDiscoConfig::ren
     std::string_view json_body = req.get_content();
     // fprintf(stderr, "GOT BODY: %s\n ==END== \n", json_body.data());
 
-    json data = json::parse(json_body);
-    // fprintf(stderr, "GOT DATA: %s\n ==END== \n", data.dump(2).c_str());
-
-    auto config = data.get<DiscoConfig>();
+    DiscoConfig config;
+    try {
+        json data = json::parse(json_body);
+        // fprintf(stderr, "GOT DATA: %s\n ==END== \n", data.dump(2).c_str());
+        config = data.get<DiscoConfig>();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Rejected config: %s\n", e.what());
+        return std::shared_ptr<httpserver::http_response>(new httpserver::string_response(e.what(), httpserver::http::http_utils::http_bad_request));
+    }
     this->manager.set_config(config.controllerID, config);
 
     fprintf(stderr, "Updated config for %s\n", config.controllerID.c_str());
@@ -77,3 +100,90 @@ std::shared_ptr<httpserver::http_response> ChromaWebServer::PostChromaScript::re
         );
     return std::shared_ptr<httpserver::http_response>(new httpserver::string_response(output.str(), httpserver::http::http_utils::http_bad_request));
 }
+
+// Escapes a Prometheus label value
+static std::string escape_label(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"')
+            escaped += '\\';
+        if (c == '\n')
+            escaped += "\\n";
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+std::shared_ptr<httpserver::http_response> ChromaWebServer::GetMetrics::render_GET(const httpserver::http_request &req) {
+    std::vector<std::shared_ptr<ChromaOutput>> outputs = this->controller.get_outputs();
+    std::stringstream out;
+
+    out << "# HELP chroma_stage_seconds Time spent in each stage of a frame, quantiles over the last minute\n";
+    out << "# TYPE chroma_stage_seconds summary\n";
+    std::stringstream max_out;
+    for (auto& output : outputs) {
+        std::string id = escape_label(output->get_component_id());
+        for (int i = 0; i < NUM_FRAME_STAGES; i++) {
+            FrameStage stage = static_cast<FrameStage>(i);
+            StageSnapshot snapshot = output->get_stage_times(stage);
+            std::string labels = "output=\"" + id + "\",stage=\"" + frame_stage_to_string(stage) + "\"";
+            for (double quantile : {0.5, 0.99})
+                out << "chroma_stage_seconds{" << labels << ",quantile=\"" << quantile << "\"} " << snapshot.recent.quantile(quantile) / 1e9 << "\n";
+            out << "chroma_stage_seconds_sum{" << labels << "} " << snapshot.sum_ns / 1e9 << "\n";
+            out << "chroma_stage_seconds_count{" << labels << "} " << snapshot.count << "\n";
+            max_out << "chroma_stage_max_seconds{" << labels << "} " << snapshot.recent.get_max() / 1e9 << "\n";
+        }
+    }
+    out << "# HELP chroma_stage_max_seconds Longest time spent in each stage of a frame over the last minute\n";
+    out << "# TYPE chroma_stage_max_seconds gauge\n";
+    out << max_out.str();
+
+    const char* counters[][2] = {
+        {"chroma_frames_total", "Frames rendered"},
+        {"chroma_frames_late_total", "Frames that finished after their deadline"},
+        {"chroma_frames_dropped_total", "Frame deadlines skipped to catch up after late frames"}
+    };
+    for (int i = 0; i < 3; i++) {
+        out << "# HELP " << counters[i][0] << " " << counters[i][1] << "\n";
+        out << "# TYPE " << counters[i][0] << " counter\n";
+        for (auto& output : outputs) {
+            FramePacerStats stats = output->get_frame_stats();
+            uint64_t values[] = {stats.frames, stats.overruns, stats.skipped};
+            out << counters[i][0] << "{output=\"" << escape_label(output->get_component_id()) << "\"} " << values[i] << "\n";
+        }
+    }
+
+    out << "# HELP chroma_quality_level Level the quality governor has lowered the output to, 0 for full quality\n";
+    out << "# TYPE chroma_quality_level gauge\n";
+    for (auto& output : outputs)
+        out << "chroma_quality_level{output=\"" << escape_label(output->get_component_id()) << "\"} " << output->get_quality_level() << "\n";
+
+    return std::shared_ptr<httpserver::http_response>(new httpserver::string_response(out.str(), httpserver::http::http_utils::http_ok,
+        "text/plain; version=0.0.4"));
+}
+
+std::shared_ptr<httpserver::http_response> ChromaWebServer::GetProfile::render_GET(const httpserver::http_request &req) {
+    json outputs = json::array();
+    for (auto& output : this->controller.get_outputs()) {
+        uint64_t frames;
+        json nodes = json::array();
+        for (auto& entry : output->get_profiler().get_entries(frames)) {
+            nodes.push_back({
+                {"layer", entry.layer},
+                {"path", entry.path},
+                {"type", entry.type},
+                {"tick_us", frames > 0 ? entry.tick_ns / frames / 1e3 : 0},
+                {"draw_us", frames > 0 ? entry.draw_ns / frames / 1e3 : 0}
+            });
+        }
+        outputs.push_back({
+            {"id", output->get_component_id()},
+            {"profiling", output->is_profiling()},
+            {"frames", frames},
+            {"nodes", nodes}
+        });
+    }
+    return std::shared_ptr<httpserver::http_response>(new httpserver::string_response(json({{"outputs", outputs}}).dump(),
+        httpserver::http::http_utils::http_ok, "application/json"));
+}
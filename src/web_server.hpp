@@ -50,6 +50,22 @@ class ChromaWebServer {
                 std::shared_ptr<httpserver::http_response> render_POST(const httpserver::http_request& req);
         };
         
+        class GetMetrics : public ChromaHTTPResource {
+            private:
+                ChromaController& controller;
+            public:
+                GetMetrics(ChromaController& controller) : ChromaHTTPResource("/metrics"), controller(controller) { }
+                std::shared_ptr<httpserver::http_response> render_GET(const httpserver::http_request& req);
+        };
+        
+        class GetProfile : public ChromaHTTPResource {
+            private:
+                ChromaController& controller;
+            public:
+                GetProfile(ChromaController& controller) : ChromaHTTPResource("/profile"), controller(controller) { }
+                std::shared_ptr<httpserver::http_response> render_GET(const httpserver::http_request& req);
+        };
+
         ChromaController& chroma;
         ChromaCLI& cli;
         DiscoConfigManager& disco;
@@ -59,11 +75,16 @@ class ChromaWebServer {
         PostChromaConfig chroma_config_rsc = PostChromaConfig(this->chroma);
         PostDiscoConfig disco_config_rsc = PostDiscoConfig(this->disco);
         PostChromaScript chroma_script_rsc = PostChromaScript(this->cli);
+        GetMetrics metrics_rsc = GetMetrics(this->chroma);
+        GetProfile profile_rsc = GetProfile(this->chroma);
 
         void add_POST_route(ChromaHTTPResource& resource);
+        void add_GET_route(ChromaHTTPResource& resource);
     public:
         ChromaWebServer(ChromaController& chroma, ChromaCLI& cli, DiscoConfigManager& disco, int port);
         void start();
+        // Serves only GET /api/metrics and /api/profile, nothing that changes Chroma or Disco
+        void start_read_only();
 };
 
 
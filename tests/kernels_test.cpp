@@ -0,0 +1,128 @@
+// Checks that every kernel table the CPU supports gives bit for bit the results of the scalar kernels.
+//   ./kernels_test
+// Prints one line per instruction set and exits with 1 if any kernel differs.
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "kernels.hpp"
+
+#define TEST_MAX_LENGTH 70 // Covers the vector loops and every remainder up to a few AVX-512 registers
+#define TEST_LONG_LENGTH 1000
+
+static int failures = 0;
+
+// Values the kernels see in practice, plus the edges of their clamps and of half floats
+std::vector<float> make_values(std::mt19937& rng, size_t n) {
+    const float edges[] = {0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 2.0f, 1e-6f, 6e-5f, 65504.0f, 70000.0f, -70000.0f, 1.0f / 4095, 254.5f / 255};
+    std::uniform_real_distribution<float> wide(-4, 4);
+    std::uniform_int_distribution<int> pick(0, 3);
+    std::vector<float> values(n);
+    for (size_t i = 0; i < n; i++) {
+        if (pick(rng) == 0)
+            values[i] = edges[rng() % (sizeof(edges) / sizeof(edges[0]))];
+        else
+            values[i] = wide(rng);
+    }
+    return values;
+}
+
+template <class T>
+void check(const std::string& isa, const char* kernel, size_t n, const std::vector<T>& expected, const std::vector<T>& actual) {
+    if (memcmp(expected.data(), actual.data(), n * sizeof(T)) == 0)
+        return;
+    for (size_t i = 0; i < n; i++) {
+        if (memcmp(&expected[i], &actual[i], sizeof(T)) != 0) {
+            fprintf(stderr, "%s %s differs from scalar at %zu of %zu: %g != %g\n", isa.c_str(), kernel, i, n,
+                (double) expected[i], (double) actual[i]);
+            break;
+        }
+    }
+    failures++;
+}
+
+// Runs each kernel of both tables on the same inputs, each output buffer starting from the same garbage
+void compare_kernels(const SimdKernels& kernels, std::mt19937& rng, size_t n) {
+    const SimdKernels& scalar = SCALAR_KERNELS;
+    std::string isa = kernels.isa;
+    std::vector<float> a = make_values(rng, n);
+    std::vector<float> b = make_values(rng, n);
+    std::vector<float> t = make_values(rng, n);
+    float s = make_values(rng, 1)[0];
+
+    std::vector<float> expected(n, -3), actual(n, -3);
+    scalar.add(expected.data(), a.data(), b.data(), n);
+    kernels.add(actual.data(), a.data(), b.data(), n);
+    check(isa, "add", n, expected, actual);
+
+    scalar.scale(expected.data(), a.data(), s, n);
+    kernels.scale(actual.data(), a.data(), s, n);
+    check(isa, "scale", n, expected, actual);
+
+    scalar.lerp(expected.data(), a.data(), b.data(), t.data(), n);
+    kernels.lerp(actual.data(), a.data(), b.data(), t.data(), n);
+    check(isa, "lerp", n, expected, actual);
+
+    scalar.tent(expected.data(), a.data(), n);
+    kernels.tent(actual.data(), a.data(), n);
+    check(isa, "tent", n, expected, actual);
+
+    scalar.clamp(expected.data(), a.data(), 0, 1, n);
+    kernels.clamp(actual.data(), a.data(), 0, 1, n);
+    check(isa, "clamp", n, expected, actual);
+
+    std::vector<uint8_t> expected_bytes(n, 7), actual_bytes(n, 7);
+    scalar.quantize(expected_bytes.data(), a.data(), n);
+    kernels.quantize(actual_bytes.data(), a.data(), n);
+    check(isa, "quantize", n, expected_bytes, actual_bytes);
+
+    std::vector<uint16_t> expected_shorts(n, 7), actual_shorts(n, 7);
+    scalar.quantize_index(expected_shorts.data(), a.data(), n);
+    kernels.quantize_index(actual_shorts.data(), a.data(), n);
+    check(isa, "quantize_index", n, expected_shorts, actual_shorts);
+
+    scalar.to_half(expected_shorts.data(), a.data(), n);
+    kernels.to_half(actual_shorts.data(), a.data(), n);
+    check(isa, "to_half", n, expected_shorts, actual_shorts);
+
+    scalar.from_half(expected.data(), expected_shorts.data(), n);
+    kernels.from_half(actual.data(), expected_shorts.data(), n);
+    check(isa, "from_half", n, expected, actual);
+
+    // The pixel kernels take n pixels of 4 floats
+    std::vector<float> src = make_values(rng, n * 4);
+    std::vector<float> dst = make_values(rng, n * 4);
+    const char* modes[BLEND_MODES] = {"blend over", "blend add", "blend multiply", "blend max", "blend screen"};
+    for (int mode = 0; mode < BLEND_MODES; mode++) {
+        expected = dst;
+        actual = dst;
+        scalar.blend[mode](expected.data(), src.data(), n);
+        kernels.blend[mode](actual.data(), src.data(), n);
+        check(isa, modes[mode], n * 4, expected, actual);
+    }
+
+    std::vector<float> expected_factors = t, actual_factors = t;
+    expected = dst;
+    actual = dst;
+    scalar.accumulate_over(expected.data(), expected_factors.data(), src.data(), n);
+    kernels.accumulate_over(actual.data(), actual_factors.data(), src.data(), n);
+    check(isa, "accumulate_over", n * 4, expected, actual);
+    check(isa, "accumulate_over factors", n, expected_factors, actual_factors);
+}
+
+int main() {
+    for (const std::string& isa : get_supported_kernels()) {
+        set_kernels(isa);
+        const SimdKernels& kernels = get_kernels();
+        int before = failures;
+        std::mt19937 rng(1);
+        for (size_t n = 0; n <= TEST_MAX_LENGTH; n++)
+            compare_kernels(kernels, rng, n);
+        compare_kernels(kernels, rng, TEST_LONG_LENGTH);
+        printf("%s: %s\n", isa.c_str(), failures == before ? "ok" : "FAILED");
+    }
+    return failures == 0 ? 0 : 1;
+}